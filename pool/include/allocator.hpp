@@ -16,12 +16,16 @@
 #include "fixpool.hpp"
 #include "memory_pool.hpp"
 #include <bit>
+#include <atomic>
 #include <cassert>
 #include <mutex>
 #include <unordered_map>
 
 namespace pool
 {
+    template <typename Allocator>
+    struct thread_arena;
+
 #if defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
     template <allocator_reporter R, pool_reporter P>
 #elif !defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
@@ -49,8 +53,10 @@ namespace pool
 
         static constexpr auto pool_type_size_adjusted = static_cast<std::size_t>(static_cast<int>(2 << (std::bit_width(sizeof(pool_type)) - 1)));
 
-        global_allocator() :
-            global_block(32768, pool_type_size_adjusted)
+        // An allocator that is not shared is used by one thread only, so it does not lock
+        explicit global_allocator(bool shared = true) :
+            global_block(32768, pool_type_size_adjusted),
+            thread_shared { shared }
         {
         }
 
@@ -61,7 +67,7 @@ namespace pool
         }
 #endif /*REPORT_ALLOCATIONS*/
 
-        auto create_pool(std::size_t size, std::size_t chunkSize) noexcept -> auto
+        auto create_pool(std::size_t size, std::size_t chunkSize) -> auto
         {
             auto find = local_blocks.find(chunkSize);
             if (find == local_blocks.end())
@@ -75,7 +81,9 @@ namespace pool
 
         auto allocate(std::size_t n) -> void *
         {
-            std::unique_lock<std::mutex> lock(thread_protection);
+            std::unique_lock<std::mutex> lock(thread_protection, std::defer_lock);
+            if (thread_shared)
+                lock.lock();
 
             std::size_t chunk_size = this_type::adjust_chunk_size(n);
 
@@ -90,7 +98,9 @@ namespace pool
 
         auto deallocate(void *p, std::size_t chunkSize) -> void
         {
-            std::unique_lock<std::mutex> lock(thread_protection);
+            std::unique_lock<std::mutex> lock(thread_protection, std::defer_lock);
+            if (thread_shared)
+                lock.lock();
 
             auto find = local_blocks.find(chunkSize);
             if (find != local_blocks.end())
@@ -99,6 +109,20 @@ namespace pool
             }
         }
 
+        // true if p was given by the pool of chunkSize of this allocator
+        // It does not lock: only for an allocator that no other thread is using
+        MP_NODISCARD auto owns(const void *p, std::size_t chunkSize) const noexcept -> bool
+        {
+            const auto find = local_blocks.find(chunkSize);
+            return find != local_blocks.end() && find->second->owns(p);
+        }
+
+        // The arena of the calling thread, if there is one, or the shared allocator
+        MP_NODISCARD static auto current() noexcept -> this_type *
+        {
+            return _thread != nullptr ? _thread : _global;
+        }
+
 
 
     public:
@@ -137,11 +161,18 @@ namespace pool
 #endif /*REPORT_ALLOCATIONS*/
 
     private:
-        int64_t count_ref { 0 };
+        std::atomic<int64_t> count_ref { 0 };
         std::mutex thread_protection;
         global_pool global_block;
+        bool thread_shared { true };
         std::unordered_map<std::size_t, pool_type *> local_blocks;
 
+        template <typename Allocator>
+        friend struct thread_arena;
+
+        // Set while a thread_arena is alive on the thread
+        inline static thread_local this_type *_thread { nullptr };
+
 #if defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
         template <typename T, typename C, typename K>
         friend struct pool_allocator;
@@ -168,7 +199,8 @@ namespace pool
 #pragma GCC diagnostic ignored "-Wglobal-constructors"
 #pragma GCC diagnostic ignored "-Wexit-time-destructors"
 #endif
-    static std::mutex _construct_mutex;
+    // One mutex for the whole program: it creates and destroys the shared allocator of every translation unit
+    inline std::mutex _construct_mutex;
 #if defined(__clang__) || defined(__GNUC__)
 #pragma GCC diagnostic pop
 #endif
@@ -200,6 +232,13 @@ namespace pool
     private:
         auto initialize_pool() -> void
         {
+            // A thread with an arena holds a reference to the shared allocator, which cannot go away meanwhile
+            if (global_allocator::_thread != nullptr)
+            {
+                add_reference();
+                return;
+            }
+
             std::unique_lock<std::mutex> lock(_construct_mutex);
             if (global_allocator::_global == nullptr)
             {
@@ -214,6 +253,16 @@ namespace pool
 #endif
         }
 
+        // Only for a thread that already holds a reference: the count is not 0 and the shared allocator stays, so there is no lock
+        auto add_reference() noexcept -> void
+        {
+            assert(global_allocator::_global != nullptr);
+            global_allocator::_global->count_ref.fetch_add(1, std::memory_order_relaxed);
+#ifdef REPORT_ALLOCATIONS
+            global_allocator::_global->reporter().add_ref_count(global_allocator::_global->count_ref);
+#endif /*REPORT_ALLOCATIONS*/
+        }
+
     public:
         auto create_pool(std::size_t chunk_size) -> void
         {
@@ -229,16 +278,22 @@ namespace pool
 
         ~pool_allocator()
         {
-            std::unique_lock<std::mutex> lock(_construct_mutex);
-            if (global_allocator::_global)
-            {
+            if (global_allocator::_global == nullptr)
+                return;
 
-                --global_allocator::_global->count_ref;
+            // Only the last reference locks; a constructor may have taken a new one before the lock
+            const auto count = global_allocator::_global->count_ref.fetch_sub(1, std::memory_order_acq_rel) - 1;
 
 #ifdef REPORT_ALLOCATIONS
-                global_allocator::_global->reporter().sub_ref_count(global_allocator::_global->count_ref);
+            global_allocator::_global->reporter().sub_ref_count(count);
 #endif /*REPORT_ALLOCATIONS*/
 
+            if (count > 0)
+                return;
+
+            std::unique_lock<std::mutex> lock(_construct_mutex);
+            if (global_allocator::_global)
+            {
                 if (global_allocator::_global->count_ref <= 0)
                 {
                     // Since std::unordered_map will try to call the destructor of an allocated block
@@ -262,9 +317,9 @@ namespace pool
         pool_allocator(const pool_allocator<T> &) noexcept
 #endif
         {
-            std::unique_lock<std::mutex> lock(_construct_mutex);
+            // The allocator copied holds a reference
             assert(global_allocator::_global != nullptr);
-            ++global_allocator::_global->count_ref;
+            global_allocator::_global->count_ref.fetch_add(1, std::memory_order_relaxed);
 #ifdef REPORT_ALLOCATIONS
             global_allocator::_global->reporter().copy_ctor_ref_count(global_allocator::_global->count_ref);
 #endif /*REPORT_ALLOCATIONS*/
@@ -273,9 +328,9 @@ namespace pool
 #if defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
         pool_allocator(pool_allocator<T, R, P> &&) noexcept
         {
-            std::unique_lock<std::mutex> lock(_construct_mutex);
+            // The allocator copied holds a reference
             assert(global_allocator::_global != nullptr);
-            ++global_allocator::_global->count_ref;
+            global_allocator::_global->count_ref.fetch_add(1, std::memory_order_relaxed);
 #ifdef REPORT_ALLOCATIONS
             global_allocator::_global->reporter().move_ctor_ref_count(global_allocator::_global->count_ref);
 #endif /*REPORT_ALLOCATIONS*/
@@ -283,9 +338,9 @@ namespace pool
 #elif !defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
         pool_allocator(pool_allocator<T, P> &&) noexcept
         {
-            std::unique_lock<std::mutex> lock(_construct_mutex);
+            // The allocator copied holds a reference
             assert(global_allocator::_global != nullptr);
-            ++global_allocator::_global->count_ref;
+            global_allocator::_global->count_ref.fetch_add(1, std::memory_order_relaxed);
 #ifdef REPORT_ALLOCATIONS
             global_allocator::_global->reporter().move_ctor_ref_count(global_allocator::_global->count_ref);
 #endif /*REPORT_ALLOCATIONS*/
@@ -293,9 +348,9 @@ namespace pool
 #else
         pool_allocator(pool_allocator<T> &&) noexcept
         {
-            std::unique_lock<std::mutex> lock(_construct_mutex);
+            // The allocator copied holds a reference
             assert(global_allocator::_global != nullptr);
-            ++global_allocator::_global->count_ref;
+            global_allocator::_global->count_ref.fetch_add(1, std::memory_order_relaxed);
 #ifdef REPORT_ALLOCATIONS
             global_allocator::_global->reporter().move_ctor_ref_count(global_allocator::_global->count_ref);
 #endif /*REPORT_ALLOCATIONS*/
@@ -313,7 +368,7 @@ namespace pool
             global_allocator::_global->reporter().alloc_request(n * sizeof(T));
 #endif /*REPORT_ALLOCATIONS*/
 
-            if (auto *t = reinterpret_cast<value_type *>(global_allocator::_global->allocate(n * sizeof(value_type))); t)
+            if (auto *t = reinterpret_cast<value_type *>(global_allocator::current()->allocate(n * sizeof(value_type))); t)
             {
                 return t;
             }
@@ -337,7 +392,11 @@ namespace pool
                 chunk_size    = static_cast<std::size_t>(static_cast<int>(2 << (bw - 1)));
             }
 
-            global_allocator::_global->deallocate(p, chunk_size);
+            // Memory of the shared pools can be released while an arena is alive
+            if (auto *arena = global_allocator::_thread; arena != nullptr && arena->owns(p, chunk_size))
+                arena->deallocate(p, chunk_size);
+            else
+                global_allocator::_global->deallocate(p, chunk_size);
         }
 
         static auto get_global_allocator() -> auto
@@ -346,6 +405,42 @@ namespace pool
         }
     };
 
+    /// \brief While an arena is alive, the allocations of the thread that created it are served by pools of its own,
+    /// \brief without locking. Memory of the shared pools that the thread releases goes back to them
+    /// \note Memory allocated in the arena must be released by the same thread, before the arena is destroyed
+    /// \note Allocator is any pool_allocator; arenas of one thread can be nested
+    template <typename Allocator>
+    struct thread_arena final
+    {
+        using global_allocator = typename Allocator::global_allocator;
+
+        thread_arena() :
+            _previous { global_allocator::_thread },
+            _arena { false }
+        {
+            // From here the allocators of the thread take references to the shared allocator without locking
+            global_allocator::_thread = &_arena;
+        }
+
+        ~thread_arena()
+        {
+            global_allocator::_thread = _previous;
+
+            // Same as for the shared allocator: the blocks are released before the map is destroyed
+            for (auto &[chunk, block] : _arena.local_blocks)
+            {
+                _arena.global_block.release(block);
+            }
+        }
+
+        thread_arena(const thread_arena &)            = delete;
+        thread_arena &operator=(const thread_arena &) = delete;
+
+    private:
+        Allocator _reference; // keeps the shared allocator alive while the arena is
+        global_allocator *_previous;
+        global_allocator _arena;
+    };
 
 #if defined(REPORT_ALLOCATIONS) && defined(CHECK_MEMORY_LEAK)
     template <class T, class U, typename R, typename P>
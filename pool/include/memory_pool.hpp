@@ -16,6 +16,7 @@
 #include <bit>
 #include <cstdint>
 #include <memory>
+#include <new>
 #if defined(__APPLE__)
 #include <unistd.h>
 #elif defined(__linux__) || defined(__MINGW32__)
@@ -116,13 +117,15 @@ namespace pool
         {
             *pBlock = new block(block_size, chunk_size); // Call the block constructor to initialize all the internal variables
 
-            if (*pBlock == nullptr)
-                throw std::runtime_error("block info: out of memory");
-
             (*pBlock)->_block = std::aligned_alloc(chunk_size, block_size);
 
             if ((*pBlock)->_block == nullptr)
-                throw std::runtime_error("block: out of memory");
+            {
+                // Out of memory is a std::bad_alloc, as for any allocator; the pool is left as it was
+                delete *pBlock;
+                *pBlock = nullptr;
+                throw std::bad_alloc();
+            }
 
 #ifdef REPORT_ALLOCATIONS
             reporter.allocate_block(*pBlock, block_size, chunk_size);
@@ -221,7 +224,18 @@ namespace pool
             if constexpr (std::is_same<void, T>::value)
                 return new (get_available_chunk()) void *;
             else
-                return new (get_available_chunk()) T(std::forward<Args>(args)...);
+            {
+                auto *chunk = get_available_chunk();
+                try
+                {
+                    return new (chunk) T(std::forward<Args>(args)...);
+                } catch (...)
+                {
+                    // The chunk of an object that could not be constructed goes back to the pool
+                    release(chunk);
+                    throw;
+                }
+            }
         }
 
         void release(T *&ptr)
@@ -331,6 +345,19 @@ namespace pool
             ptr = nullptr;
         }
 
+        /// \return true if p is a chunk of one of the blocks of the pool
+        MP_NODISCARD auto owns(const void *p) const noexcept -> bool
+        {
+            const auto *address = static_cast<const uint8_t *>(p);
+            for (const block *current = first_block; current != nullptr; current = current->next_block)
+            {
+                if (address >= current->block_beginning && address < current->block_end)
+                    return true;
+            }
+
+            return false;
+        }
+
         MP_NODISCARD auto get_chunk_size() const noexcept -> size_t
         {
             return chunk_size;
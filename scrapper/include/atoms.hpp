@@ -0,0 +1,201 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 07/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_ATOMS_HPP
+#define WBSCRP_ATOMS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace scrp
+{
+    /// \brief Small integer that identifies a standard HTML element or attribute name
+    /// \note Ids are given by the order of atoms::names; they are stable within a build of the library only
+    using atom_id = uint16_t;
+
+    /// \brief Atom of every name that is not in the table
+    inline constexpr atom_id no_atom = 0;
+} // namespace scrp
+
+namespace scrp::atoms
+{
+    // The index of a name is its atom id. Element and attribute names share the table; every name appears once
+    inline constexpr std::array<std::string_view, 297> names {
+        "",
+        // Elements
+        "a", "abbr", "address", "area", "article", "aside", "audio", "b", "base", "bdi", "bdo", "blockquote", "body", "br",
+        "button", "canvas", "caption", "cite", "code", "col", "colgroup", "data", "datalist", "dd", "del", "details", "dfn",
+        "dialog", "div", "dl", "dt", "em", "embed", "fieldset", "figcaption", "figure", "footer", "form", "h1", "h2", "h3",
+        "h4", "h5", "h6", "head", "header", "hgroup", "hr", "html", "i", "iframe", "img", "input", "ins", "kbd", "label",
+        "legend", "li", "link", "main", "map", "mark", "math", "menu", "meta", "meter", "nav", "noscript", "object", "ol",
+        "optgroup", "option", "output", "p", "param", "picture", "pre", "progress", "q", "rp", "rt", "ruby", "s", "samp",
+        "script", "search", "section", "select", "slot", "small", "source", "span", "strong", "style", "sub", "summary",
+        "sup", "svg", "table", "tbody", "td", "template", "textarea", "tfoot", "th", "thead", "time", "title", "tr", "track",
+        "u", "ul", "var", "video", "wbr",
+        // Obsolete elements that the tokenizer and the tree construction still know about
+        "acronym", "applet", "basefont", "bgsound", "big", "blink", "center", "dir", "font", "frame", "frameset", "image",
+        "isindex", "keygen", "listing", "marquee", "menuitem", "nobr", "noembed", "noframes", "plaintext", "rb", "rtc",
+        "strike", "tt", "xmp",
+        // Attributes that are not element names
+        "accept", "accept-charset", "accesskey", "action", "align", "allow", "allowfullscreen", "alt", "aria-describedby",
+        "aria-hidden", "aria-label", "aria-labelledby", "as", "async", "autocapitalize", "autocomplete", "autofocus",
+        "autoplay", "bgcolor", "blocking", "border", "cellpadding", "cellspacing", "charset", "checked", "class", "clear",
+        "color", "cols", "colspan", "content", "contenteditable", "controls", "coords", "crossorigin", "datetime",
+        "decoding", "default", "defer", "dirname", "disabled", "download", "draggable", "enctype", "enterkeyhint",
+        "fetchpriority", "for", "formaction", "formenctype", "formmethod", "formnovalidate", "formtarget", "frameborder",
+        "headers", "height", "hidden", "high", "href", "hreflang", "hspace", "http-equiv", "id", "inert", "inputmode",
+        "integrity", "is", "ismap", "itemid", "itemprop", "itemref", "itemscope", "itemtype", "kind", "lang", "language",
+        "list", "loading", "loop", "low", "marginheight", "marginwidth", "max", "maxlength", "media", "method", "min",
+        "minlength", "multiple", "muted", "name", "nomodule", "nonce", "noshade", "novalidate", "nowrap", "onblur",
+        "onchange", "onclick", "onerror", "onfocus", "oninput", "onkeydown", "onkeyup", "onload", "onmouseout",
+        "onmouseover", "onsubmit", "open", "optimum", "pattern", "ping", "placeholder", "playsinline", "popover",
+        "popovertarget", "popovertargetaction", "poster", "preload", "property", "readonly", "referrerpolicy", "rel",
+        "required", "rev", "reversed", "role", "rows", "rowspan", "sandbox", "scope", "scrolling", "selected",
+        "shadowrootmode", "shape", "size", "sizes", "spellcheck", "src", "srcdoc", "srclang", "srcset", "start", "step",
+        "tabindex", "target", "text", "translate", "type", "usemap", "valign", "value", "vspace", "width", "wrap",
+        "xmlns",
+    };
+
+    // Hash and displace: a name goes to a bucket by its hash, and every bucket has the seed that moves its names to
+    // free slots. Buckets are placed from the largest to the smallest when the table is built at compile time
+    inline constexpr std::size_t bucket_count = 128;
+    inline constexpr std::size_t slot_count   = 1024;
+
+    [[nodiscard]] constexpr auto hash(std::string_view name) noexcept -> uint32_t
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (const auto ch : name)
+        {
+            h ^= static_cast<uint8_t>(ch);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    [[nodiscard]] constexpr auto mix(uint32_t h, uint32_t seed) noexcept -> uint32_t
+    {
+        // Finalizer of MurmurHash3
+        h ^= seed * 0x9E3779B9u;
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+    [[nodiscard]] constexpr auto bucket_of(uint32_t h) noexcept -> std::size_t
+    {
+        return mix(h, 0) % bucket_count;
+    }
+
+    [[nodiscard]] constexpr auto slot_of(uint32_t h, uint16_t seed) noexcept -> std::size_t
+    {
+        return mix(h, seed) % slot_count;
+    }
+
+    struct table
+    {
+        std::array<uint16_t, bucket_count> seeds {};
+        std::array<atom_id, slot_count> slots {}; // no_atom marks a free slot
+    };
+
+    [[nodiscard]] constexpr auto build_table() -> table
+    {
+        table result {};
+
+        // Names grouped by bucket
+        std::array<uint32_t, names.size()> hashes {};
+        std::array<uint16_t, bucket_count + 1> first {};
+        for (atom_id id = 1; id < names.size(); ++id)
+        {
+            hashes[id] = hash(names[id]);
+            ++first[bucket_of(hashes[id]) + 1];
+        }
+        for (std::size_t b = 0; b < bucket_count; ++b)
+            first[b + 1] += first[b];
+
+        std::array<atom_id, names.size()> members {};
+        std::array<uint16_t, bucket_count> filled {};
+        for (atom_id id = 1; id < names.size(); ++id)
+        {
+            const auto b                       = bucket_of(hashes[id]);
+            members[first[b] + filled[b]++] = id;
+        }
+
+        std::array<uint16_t, bucket_count> order {};
+        for (std::size_t b = 0; b < bucket_count; ++b)
+            order[b] = static_cast<uint16_t>(b);
+        std::sort(order.begin(), order.end(), [&](uint16_t b0, uint16_t b1) { return filled[b0] > filled[b1]; });
+
+        for (const auto b : order)
+        {
+            if (filled[b] == 0)
+                break;
+
+            for (uint16_t seed = 1;; ++seed)
+            {
+                // A name that is twice in the table can never be placed; this ends the build
+                if (seed == UINT16_MAX)
+                    throw "atoms: no seed places every name of a bucket";
+
+                std::array<std::size_t, 16> taken {};
+                std::size_t count = 0;
+                bool placed       = true;
+
+                for (auto m = first[b]; m < first[b + 1] && placed; ++m)
+                {
+                    const auto slot = slot_of(hashes[members[m]], seed);
+                    placed          = result.slots[slot] == no_atom && std::find(taken.begin(), taken.begin() + count, slot) == taken.begin() + count;
+                    taken[count++]  = slot;
+                }
+
+                if (!placed)
+                    continue;
+
+                for (auto m = first[b]; m < first[b + 1]; ++m)
+                    result.slots[slot_of(hashes[members[m]], seed)] = members[m];
+                result.seeds[b] = seed;
+                break;
+            }
+        }
+
+        return result;
+    }
+
+    inline constexpr table atom_table = build_table();
+} // namespace scrp::atoms
+
+namespace scrp
+{
+    /// \return The atom of name, or no_atom if name is not a standard element or attribute name
+    /// \note Names are compared as given; the tokenizer gives tag and attribute names in lower case
+    /// \note Usable at compile time, for instance as a case label: case atom_of("a"):
+    [[nodiscard]] constexpr auto atom_of(std::string_view name) noexcept -> atom_id
+    {
+        const auto h    = atoms::hash(name);
+        const auto seed = atoms::atom_table.seeds[atoms::bucket_of(h)];
+        const auto id   = atoms::atom_table.slots[atoms::slot_of(h, seed)];
+        return atoms::names[id] == name ? id : no_atom;
+    }
+
+    /// \return The name of atom; an empty view for no_atom
+    [[nodiscard]] constexpr auto atom_name(atom_id atom) noexcept -> std::string_view
+    {
+        return atom < atoms::names.size() ? atoms::names[atom] : std::string_view {};
+    }
+} // namespace scrp
+
+#endif // WBSCRP_ATOMS_HPP
@@ -0,0 +1,180 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 08/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_BATCH_TOKENIZER_HPP
+#define WBSCRP_BATCH_TOKENIZER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "sink_tokenizer.hpp"
+
+namespace scrp
+{
+    /// \brief Outcome of one document of batch_tokenize()
+    struct batch_document_result
+    {
+        bool tokenized { false };               // false if the document is empty or if an exception was thrown
+        std::vector<parser_error> errors;       // recoverable parse errors kept by options.errors
+        std::size_t error_count { 0 };          // see Tokenizer::error_count()
+        std::exception_ptr exception;           // thrown by the tokenizer or by the sink while the document was tokenized
+        std::size_t worker { 0 };               // index of the worker that tokenized the document
+        std::chrono::nanoseconds elapsed { 0 }; // time spent in the document, the calls to the sink included
+    };
+
+    struct batch_stats
+    {
+        std::size_t documents { 0 }; // documents tokenized
+        std::size_t failed { 0 };    // documents whose tokenization threw
+        std::size_t bytes { 0 };     // size of the documents tokenized
+        std::size_t errors { 0 };    // recoverable parse errors of every document, counted whether they were kept or not
+        std::size_t workers { 0 };
+        std::chrono::nanoseconds elapsed { 0 }; // wall time of the batch
+        std::chrono::nanoseconds busy { 0 };    // time spent in documents, added up over the workers
+    };
+
+    struct batch_result
+    {
+        std::vector<batch_document_result> documents; // one per document, in the order they were given
+        batch_stats stats;
+    };
+
+    struct batch_options
+    {
+        std::size_t threads { 0 };      // the calling one included; 0 uses one per hardware thread
+        bool thread_arenas { true };    // every worker allocates from pools of its own instead of the shared ones
+        bool use_source_spans { true }; // see Tokenizer::use_source_spans()
+        std::span<const std::string_view> tag_interest {}; // see Tokenizer::set_tag_interest(); empty gives every tag
+        error_policy errors { error_policy::all };         // see Tokenizer::set_error_policy()
+        std::size_t error_limit { 0 };
+    };
+
+    /// \brief Tokenizes documents on a pool of worker threads
+    /// \brief Every worker takes the next document that nobody took, and has its own tokenizer, reused from document to document,
+    /// \brief and with options.thread_arenas its own memory pools, so workers do not wait on each other's allocations
+    /// \param documents Documents to tokenize in place; their memory must outlive the call
+    /// \param make_sink Called as make_sink(index of the document) by the worker that tokenizes it; returns the sink of that document
+    /// \return A result per document and the totals of the batch
+    /// \note scrp::initialize() must have been called. make_sink can be called from several threads at the same time
+    /// \note A sink is destroyed once its document is done
+    /// \note With options.thread_arenas, sinks and exceptions must not keep memory of the library's containers after the document
+    /// \note is done; copy what must be kept into containers of the standard allocator
+    template <typename SinkFactory>
+        requires token_sink<std::invoke_result_t<SinkFactory &, std::size_t>>
+    [[nodiscard]] auto batch_tokenize(std::span<const std::string_view> documents, SinkFactory &&make_sink, batch_options options = {}) -> batch_result
+    {
+        using sink_type = std::invoke_result_t<SinkFactory &, std::size_t>;
+        using clock     = std::chrono::steady_clock;
+
+        batch_result result;
+        result.documents.resize(documents.size());
+
+        if (options.threads == 0)
+            options.threads = std::max(1U, std::thread::hardware_concurrency());
+        const auto workers = std::max<std::size_t>(1, std::min(options.threads, documents.size()));
+
+        std::atomic<std::size_t> next_document { 0 };
+
+        const auto work = [&](std::size_t worker) {
+            // Everything the worker allocates lives in its arena, so the arena is created first and destroyed last
+            std::optional<thread_arena> arena;
+            if (options.thread_arenas)
+                arena.emplace();
+
+            std::optional<sink_tokenizer<sink_type>> tokenizer;
+
+            for (auto index = next_document.fetch_add(1, std::memory_order_relaxed); index < documents.size();
+                 index      = next_document.fetch_add(1, std::memory_order_relaxed))
+            {
+                auto &document   = result.documents[index];
+                document.worker  = worker;
+                const auto start = clock::now();
+                bool started     = false;
+
+                try
+                {
+                    sink_type sink = std::invoke(make_sink, index);
+
+                    if (!tokenizer)
+                    {
+                        tokenizer.emplace(sink);
+                        if (options.use_source_spans)
+                            tokenizer->tokenizer().use_source_spans();
+                        tokenizer->tokenizer().set_tag_interest(options.tag_interest);
+                        tokenizer->tokenizer().set_error_policy(options.errors, options.error_limit);
+                    }
+                    else
+                        tokenizer->set_sink(sink);
+
+                    started            = !documents[index].empty();
+                    document.tokenized = tokenizer->tokenize_view(documents[index]);
+                } catch (...)
+                {
+                    document.tokenized = false;
+                    document.exception = std::current_exception();
+                }
+
+                // The tokenizer keeps the errors of the previous document until it starts with the next one
+                if (started)
+                {
+                    const auto &tok = tokenizer->tokenizer();
+                    document.errors.reserve(tok.parse_errors().size());
+                    for (const auto &error : tok.parse_errors())
+                        document.errors.push_back(tok.describe_error(error));
+                    document.error_count = tok.error_count();
+                }
+
+                document.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+            }
+        };
+
+        const auto start = clock::now();
+        {
+            std::vector<std::jthread> pool;
+            pool.reserve(workers - 1);
+            for (std::size_t worker = 1; worker < workers; ++worker)
+                pool.emplace_back(work, worker);
+
+            work(0);
+        }
+
+        auto &stats   = result.stats;
+        stats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        stats.workers = workers;
+        for (std::size_t index = 0; index < documents.size(); ++index)
+        {
+            const auto &document = result.documents[index];
+            if (document.tokenized)
+            {
+                ++stats.documents;
+                stats.bytes += documents[index].size();
+            }
+            if (document.exception)
+                ++stats.failed;
+            stats.errors += document.error_count;
+            stats.busy += document.elapsed;
+        }
+
+        return result;
+    }
+} // namespace scrp
+
+#endif // WBSCRP_BATCH_TOKENIZER_HPP
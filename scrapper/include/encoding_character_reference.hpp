@@ -14,6 +14,7 @@
 #define WBSCRP_ENCODING_CHARACTER_REFERENCE_HPP
 
 #include "encoding.hpp"
+#include "encoding_character_reference_trie.hpp"
 #include <optional>
 
 namespace scrp::encoding
@@ -37,9 +38,9 @@ namespace scrp::encoding
     };
 
     constexpr auto _v_invalid = to_view<to_utf8<0xFFFD>()>();
-    constexpr std::string_view _sv_invalid { _v_invalid._data, _v_invalid._size };
+    constexpr std::string_view _sv_invalid { _v_invalid._data, _v_invalid._size - 1 }; // _size counts the terminator
 
-    constexpr std::array<character_reference, 2231> chref_table {
+    inline constexpr std::array<character_reference, 2231> chref_table {
         {
          { 0x1FC297A382D5BA, "ngtr;", "\xe2\x89\xaf" },
          { 0x33F254EF98D8FE, "cularr;", "\xe2\x86\xb6" },
@@ -2280,6 +2281,16 @@ namespace scrp::encoding
 
     MP_NODISCARD const character_reference &find_reference(std::string_view reference);
 
+    struct reference_match
+    {
+        const character_reference *reference { nullptr };
+        std::size_t length { 0 };
+    };
+
+    /// \brief Finds the longest reference that input begins with, walking chref_trie_nodes one character at a time
+    /// \return The reference and its length; a null reference if input doesn't begin with any
+    MP_NODISCARD auto match_reference(std::string_view input) noexcept -> reference_match;
+
 } // namespace scrp::encoding
 
 #endif // WBSCRP_ENCODING_CHARACTER_REFERENCE_HPP
@@ -0,0 +1,56 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 05/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_MAPPED_FILE_HPP
+#define WBSCRP_MAPPED_FILE_HPP
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace scrp
+{
+    /// \brief Read-only view of a whole file, mapped in memory
+    /// \note The mapping is advised for sequential access. Where mmap is not available, the file is read into memory
+    class mapped_file
+    {
+    public:
+        mapped_file() noexcept = default;
+
+        /// \throws std::system_error if the file can not be opened or mapped
+        explicit mapped_file(const std::filesystem::path &path);
+
+        mapped_file(const mapped_file &)                     = delete;
+        auto operator=(const mapped_file &) -> mapped_file & = delete;
+
+        mapped_file(mapped_file &&other) noexcept;
+        auto operator=(mapped_file &&other) noexcept -> mapped_file &;
+
+        ~mapped_file();
+
+    public:
+        /// \return The contents of the file. The view is valid while the mapped_file is alive
+        [[nodiscard]] auto view() const noexcept -> std::string_view;
+        [[nodiscard]] auto size() const noexcept -> std::size_t;
+        [[nodiscard]] auto empty() const noexcept -> bool;
+
+    private:
+        auto unmap() noexcept -> void;
+
+    private:
+        const char *_data { nullptr };
+        std::size_t _size { 0 };
+        std::unique_ptr<char[]> _copy; // only used when mmap is not available
+    };
+} // namespace scrp
+
+#endif // WBSCRP_MAPPED_FILE_HPP
@@ -14,10 +14,11 @@
 #define WBSCRP_PARSER_ERROR_HPP
 
 #include "scrapper.hpp"
+#include <cstdint>
 
 namespace scrp
 {
-    enum class parser_error_type
+    enum class parser_error_type : std::uint8_t
     {
         abrupt_closing_of_empty_comment,
         abrupt_doctype_public_identifier,
@@ -87,6 +88,31 @@ namespace scrp
         std::size_t _offset;
         std::size_t _line;
     };
+
+    /// \brief A parse error as the tokenizer keeps it, in 8 bytes: the type in the low byte and the offset in the input in the
+    /// \brief other 56 bits, enough for inputs of up to 64 PiB. The line and the column are computed by Tokenizer::describe_error()
+    struct error_record final
+    {
+        static constexpr std::size_t max_offset = (std::uint64_t { 1 } << 56) - 1;
+
+        constexpr error_record(std::size_t offset, parser_error_type type) noexcept :
+            _bits { static_cast<std::uint64_t>(offset) << 8 | static_cast<std::uint8_t>(type) }
+        {
+        }
+
+        [[nodiscard]] constexpr auto offset() const noexcept -> std::size_t
+        {
+            return static_cast<std::size_t>(_bits >> 8);
+        }
+
+        [[nodiscard]] constexpr auto type() const noexcept -> parser_error_type
+        {
+            return static_cast<parser_error_type>(_bits & 0xFF);
+        }
+
+    private:
+        std::uint64_t _bits;
+    };
 } // namespace scrp
 
 #endif // WBSCRP_PARSER_ERROR_HPP
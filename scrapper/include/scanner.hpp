@@ -0,0 +1,161 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 02/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_SCANNER_HPP
+#define WBSCRP_SCANNER_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "scrapper.hpp"
+
+namespace scrp::scanner
+{
+    /// \brief Flags of a character in char_classes
+    enum char_class : uint16_t
+    {
+        class_lower_alpha = 1 << 0,
+        class_upper_alpha = 1 << 1,
+        class_digit       = 1 << 2,
+        class_lower_hex   = 1 << 3, // a-f
+        class_upper_hex   = 1 << 4, // A-F
+        class_control     = 1 << 5,
+        class_whitespace  = 1 << 6, // tab, line feed, form feed, carriage return and space
+
+        // Characters that end a run of plain characters in a state, besides class_stream_control
+        class_tag_name_end        = 1 << 7,  // whitespace / >
+        class_attribute_name_end  = 1 << 8,  // whitespace / > = " ' <
+        class_attribute_dq_end    = 1 << 9,  // " &
+        class_attribute_sq_end    = 1 << 10, // ' &
+        class_attribute_value_end = 1 << 11, // whitespace & > " ' < = `
+        class_comment_end         = 1 << 12, // < -
+
+        class_stream_control = 1 << 13, // control characters but whitespace; a parse error where they are appended
+
+        class_alpha        = class_lower_alpha | class_upper_alpha,
+        class_alphanumeric = class_alpha | class_digit,
+        class_hex_digit    = class_digit | class_lower_hex | class_upper_hex,
+    };
+
+    [[nodiscard]] constexpr auto make_char_classes() noexcept -> std::array<uint16_t, 256>
+    {
+        std::array<uint16_t, 256> classes {};
+
+        const auto add = [&classes](std::string_view characters, uint16_t flags) {
+            for (const auto ch : characters)
+                classes[static_cast<uint8_t>(ch)] |= flags;
+        };
+
+        for (std::size_t ch = 0; ch < classes.size(); ++ch)
+        {
+            if (ch >= 'a' && ch <= 'z')
+                classes[ch] |= class_lower_alpha | (ch <= 'f' ? class_lower_hex : 0);
+            else if (ch >= 'A' && ch <= 'Z')
+                classes[ch] |= class_upper_alpha | (ch <= 'F' ? class_upper_hex : 0);
+            else if (ch >= '0' && ch <= '9')
+                classes[ch] |= class_digit;
+            // C1 controls are code points, not bytes: in UTF-8 the bytes 0x80 to 0x9F are parts of multibyte characters
+            else if (ch <= 0x1F || ch == 0x7F || (sizeof(char_type) > 1 && ch >= 0x80 && ch <= 0x9F))
+                classes[ch] |= class_control;
+        }
+
+        constexpr std::string_view whitespace { "\t\n\f\r " };
+
+        add(whitespace, class_whitespace | class_tag_name_end | class_attribute_name_end | class_attribute_value_end);
+        add("/>", class_tag_name_end | class_attribute_name_end);
+        add("=\"'<", class_attribute_name_end | class_attribute_value_end);
+        add(">`", class_attribute_value_end);
+        add("&", class_attribute_dq_end | class_attribute_sq_end | class_attribute_value_end);
+        add("\"", class_attribute_dq_end);
+        add("'", class_attribute_sq_end);
+        add("<-", class_comment_end);
+
+        for (auto &flags : classes)
+        {
+            if ((flags & class_control) != 0 && (flags & class_whitespace) == 0)
+                flags |= class_stream_control;
+        }
+
+        return classes;
+    }
+
+    /// \brief Flags of every byte; one load and a mask replace the range comparisons of the tokenizer states
+    inline constexpr std::array<uint16_t, 256> char_classes = make_char_classes();
+
+    /// \return true if ch has any of the flags in mask
+    [[nodiscard]] constexpr auto has_class(char_type ch, uint16_t mask) noexcept -> bool
+    {
+#ifdef USE_UTF16
+        // Only the first 256 code units have classes
+        if (static_cast<std::make_unsigned_t<char_type>>(ch) > 0xFF)
+            return false;
+#endif /*USE_UTF16*/
+
+        return (char_classes[static_cast<uint8_t>(ch)] & mask) != 0;
+    }
+
+    /// \return ch in lower case if it is an ASCII upper case letter; ch otherwise
+    [[nodiscard]] constexpr auto to_lower(char_type ch) noexcept -> char_type
+    {
+        return has_class(ch, class_upper_alpha) ? static_cast<char_type>(ch | 0x20) : ch;
+    }
+
+    /// \brief Finds the end of a run of characters that a state appends without looking at them one by one
+    /// \return A pointer to the first character in [first, last) that has any of the flags in mask; last if there is none
+    [[nodiscard]] auto find_class(const char_type *first, const char_type *last, uint16_t mask) noexcept -> const char_type *;
+
+    /// \brief Finds the end of a run of a tag name, or of an attribute name if attribute_name is true
+    /// \return A pointer to the first control character, whitespace, '/' or '>' in [first, last), or '=', '"', '\'' or '<'
+    /// \return for attribute names; last if there is none
+    /// \note Uses AVX2 or SSE2 when the library is built for them, otherwise a scalar loop
+    [[nodiscard]] auto find_name_end(const char_type *first, const char_type *last, bool attribute_name) noexcept -> const char_type *;
+
+    /// \brief Scalar version of find_name_end(). Used for the tails of the vectorized versions
+    [[nodiscard]] auto find_name_end_scalar(const char_type *first, const char_type *last, bool attribute_name) noexcept -> const char_type *;
+
+    /// \brief Copies [first, last) to out with the ASCII upper case letters in lower case
+    /// \return The end of the copy
+    /// \note Uses AVX2 or SSE2 when the library is built for them, otherwise a scalar loop
+    auto copy_lower(const char_type *first, const char_type *last, char_type *out) noexcept -> char_type *;
+
+    /// \brief Scalar version of copy_lower(). Used for the tails of the vectorized versions
+    auto copy_lower_scalar(const char_type *first, const char_type *last, char_type *out) noexcept -> char_type *;
+
+    /// \brief Finds the end of a run of plain text in the data state
+    /// \return A pointer to the first '<', '&' or NUL character in [first, last); last if there is none
+    /// \note Uses AVX2 or SSE2 when the library is built for them, otherwise a scalar loop
+    [[nodiscard]] auto find_data_delimiter(const char_type *first, const char_type *last) noexcept -> const char_type *;
+
+    /// \brief Scalar version of find_data_delimiter(). Used for the tails of the vectorized versions
+    [[nodiscard]] auto find_data_delimiter_scalar(const char_type *first, const char_type *last) noexcept -> const char_type *;
+
+    /// \brief Finds the next line break character
+    /// \return A pointer to the first '\\r' or '\\n' character in [first, last); last if there is none
+    /// \note Uses AVX2 or SSE2 when the library is built for them, otherwise a scalar loop
+    [[nodiscard]] auto find_line_break(const char_type *first, const char_type *last) noexcept -> const char_type *;
+
+    /// \brief Scalar version of find_line_break(). Used for the tails of the vectorized versions
+    [[nodiscard]] auto find_line_break_scalar(const char_type *first, const char_type *last) noexcept -> const char_type *;
+
+    /// \brief Finds the end tag that closes the contents of a RAWTEXT, RCDATA or script element
+    /// \param name The lower case name of the element
+    /// \return A pointer to the '<' of the first "</name" in [first, last), compared without case and followed by
+    /// \return whitespace, '/' or '>'; last if there is none
+    /// \note The end tag may extend beyond last up to end. Uses AVX2 or SSE2 to find the candidates when the library is built for them
+    [[nodiscard]] auto find_end_tag(const char_type *first, const char_type *last, const char_type *end, std::string_view name) noexcept -> const char_type *;
+
+    /// \brief Scalar version of find_end_tag(). Used for the tails of the vectorized versions
+    [[nodiscard]] auto find_end_tag_scalar(const char_type *first, const char_type *last, const char_type *end, std::string_view name) noexcept -> const char_type *;
+} // namespace scrp::scanner
+
+#endif // WBSCRP_SCANNER_HPP
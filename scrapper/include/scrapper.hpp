@@ -15,12 +15,19 @@
 
 #ifndef CHREF_TOOL
 #include "allocator.hpp"
+#include "atoms.hpp"
 #include "pool_reporter.hpp"
+#include "small_vector.hpp"
 #include <deque>
 #include <map>
+#include <memory>
+#include <span>
 #include <stack>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <variant>
+#include <vector>
 
 namespace scrp
 {
@@ -81,6 +88,16 @@ namespace scrp
     template <typename Key, typename T>
     using sc_unordered_map = std::unordered_map<Key, T, std::hash<Key>, std::equal_to<Key>, pool_allocator<std::pair<const Key, T>>>;
 
+#ifdef USE_STL_ALLOCATOR
+    /// \brief Nothing to do when the standard allocator is used
+    struct thread_arena final
+    {
+    };
+#else
+    /// \brief While alive, the allocations of the calling thread are served by pools of its own. See pool::thread_arena
+    using thread_arena = pool::thread_arena<pool_allocator<char_type>>;
+#endif /*USE_STL_ALLOCATOR*/
+
     // Call before any calls to the library
     extern bool initialize();
     extern bool is_initialized();
@@ -96,10 +113,57 @@ namespace scrp
         Tag
     };
 
-    struct Token
+    /// \brief Location of a token payload inside the tokenizer source
+    /// \note An empty span means the payload is held in the owned string of the token
+    struct source_span
+    {
+        std::size_t offset { 0 };
+        std::size_t length { 0 };
+
+        [[nodiscard]] constexpr auto empty() const noexcept -> bool
+        {
+            return length == 0;
+        }
+    };
+
+    /// \return The view of span in source if span is set; otherwise owned
+    [[nodiscard]] inline auto payload_view(std::string_view source, const sc_string &owned, const source_span &span) noexcept -> std::string_view
     {
-        virtual ~Token() = default;
+        if (span.empty())
+            return { owned.data(), owned.size() };
+        return source.substr(span.offset, span.length);
+    }
+
+    /// \brief Attribute of a tag token
+    /// \note When the tokenizer is using source spans, name and value are only set if they differ from the source
+    struct attribute
+    {
+        [[nodiscard]] inline auto name_view(std::string_view source) const noexcept -> std::string_view
+        {
+            return payload_view(source, name, name_span);
+        }
 
+        [[nodiscard]] inline auto value_view(std::string_view source) const noexcept -> std::string_view
+        {
+            return payload_view(source, value, value_span);
+        }
+
+        sc_string name;
+        sc_string value;
+        source_span name_span;
+        source_span value_span;
+        atom_id atom { no_atom }; // atom of the name; no_atom if the name is not a standard attribute name
+    };
+
+    // Almost every tag has less than 8 attributes
+    using attribute_list = small_vector<attribute, 8, pool_allocator<attribute>>;
+
+    /// \brief Attributes of a tag token
+    /// \note They are stored by the tokenizer that emitted the token, and are valid for as long as the token is
+    using attribute_span = std::span<attribute>;
+
+    struct Token
+    {
         explicit Token(TokenType tp) :
             type { tp } { }
 
@@ -118,7 +182,14 @@ namespace scrp
         inline explicit CommentToken(sc_string cmt) :
             Token(TokenType::Comment),
             comment { std::move(cmt) } { }
+
+        [[nodiscard]] inline auto view(std::string_view source) const noexcept -> std::string_view
+        {
+            return payload_view(source, comment, span);
+        }
+
         sc_string comment;
+        source_span span;
     };
 
     struct DOCTYPEToken : public Token
@@ -173,7 +244,13 @@ namespace scrp
             Token(TokenType::Character),
             code_point { std::move(cp) } { }
 
+        [[nodiscard]] inline auto view(std::string_view source) const noexcept -> std::string_view
+        {
+            return payload_view(source, code_point, span);
+        }
+
         sc_string code_point;
+        source_span span;
     };
 
     struct TagToken : public Token
@@ -185,7 +262,7 @@ namespace scrp
             Token(TokenType::Tag),
             tag_name { std::move(name) } { }
 
-        explicit TagToken(sc_string name, const sc_unordered_map<sc_string, sc_string> &attrs) :
+        explicit TagToken(sc_string name, attribute_span attrs) :
             Token(TokenType::Tag),
             tag_name { std::move(name) },
             attributes { attrs } { }
@@ -193,10 +270,9 @@ namespace scrp
         explicit TagToken(sc_string name, bool self_close) :
             Token(TokenType::Tag),
             tag_name { std::move(name) },
-            attributes {},
             self_closing { self_close } { }
 
-        explicit TagToken(sc_string name, const sc_unordered_map<sc_string, sc_string> &attrs, bool self_close) :
+        explicit TagToken(sc_string name, attribute_span attrs, bool self_close) :
             Token(TokenType::Tag),
             tag_name { std::move(name) },
             attributes { attrs },
@@ -207,58 +283,97 @@ namespace scrp
             type = TokenType::EndTag;
         }
 
-        sc_unordered_map<sc_string, sc_string> attributes;
+        [[nodiscard]] inline auto name_view(std::string_view source) const noexcept -> std::string_view
+        {
+            return payload_view(source, tag_name, name_span);
+        }
+
         sc_string tag_name;
+        attribute_span attributes;
+        source_span name_span;
+        atom_id atom { no_atom }; // atom of the tag name; no_atom if the name is not a standard element name
         bool self_closing { false };
     };
 
-    extern fixed_memory_pool<EOFToken> *_pool_eof_token;
-    extern fixed_memory_pool<CommentToken> *_pool_comment_token;
-    extern fixed_memory_pool<DOCTYPEToken> *_pool_doctype_token;
-    extern fixed_memory_pool<CDATAToken> *_pool_cdata_token;
-    extern fixed_memory_pool<CharacterToken> *_pool_character_token;
-    extern fixed_memory_pool<TagToken> *_pool_tag_token;
-
-    template <typename T>
-    inline auto get_token_pool() -> auto
+    /// \brief A token of any type stored by value
+    /// \brief The type of the token is given by Token::type; use the Tokenizer::*_token_cast functions to get the token
+    class token_record
     {
-        return nullptr;
-    }
+        // A DOCTYPE token holds three strings and a document has one at most; it is stored out of line so that it does not
+        // set the size of every record
+        using doctype_box = std::unique_ptr<DOCTYPEToken>;
+        using payload_type = std::variant<EOFToken, CommentToken, doctype_box, CDATAToken, CharacterToken, TagToken>;
+
+    public:
+        template <typename T, typename... Args>
+        explicit token_record(std::in_place_type_t<T> type, Args &&...args) :
+            payload { make_payload(type, std::forward<Args>(args)...) } { }
+
+        /// \return The token, nullptr if the token is not a T
+        template <typename T>
+        [[nodiscard]] inline auto as() noexcept -> T *
+        {
+            return find<T>(payload);
+        }
 
-    template <>
-    inline auto get_token_pool<EOFToken>() -> auto
-    {
-        return _pool_eof_token;
-    }
-    template <>
-    inline auto get_token_pool<CommentToken>() -> auto
-    {
-        return _pool_comment_token;
-    }
+        template <typename T>
+        [[nodiscard]] inline auto as() const noexcept -> const T *
+        {
+            return find<T>(payload);
+        }
 
-    template <>
-    inline auto get_token_pool<DOCTYPEToken>() -> auto
-    {
-        return _pool_doctype_token;
-    }
+        [[nodiscard]] inline auto get() const -> Token *
+        {
+            return std::visit(
+                [](auto &token) -> Token * {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(token)>, doctype_box>)
+                        return token.get();
+                    else
+                        return &token;
+                },
+                payload);
+        }
 
-    template <>
-    inline auto get_token_pool<CDATAToken>() -> auto
-    {
-        return _pool_cdata_token;
-    }
+        inline auto operator->() const -> Token *
+        {
+            return get();
+        }
 
-    template <>
-    inline auto get_token_pool<CharacterToken>() -> auto
-    {
-        return _pool_character_token;
-    }
+        inline operator Token *() const
+        {
+            return get();
+        }
 
-    template <>
-    inline auto get_token_pool<TagToken>() -> auto
-    {
-        return _pool_tag_token;
-    }
+    private:
+        template <typename T>
+        [[nodiscard]] static auto find(payload_type &payload) noexcept -> T *
+        {
+            if constexpr (std::is_same_v<T, DOCTYPEToken>)
+            {
+                const auto *box = std::get_if<doctype_box>(&payload);
+                return box != nullptr ? box->get() : nullptr;
+            }
+            else
+                return std::get_if<T>(&payload);
+        }
+
+        template <typename T, typename... Args>
+        [[nodiscard]] static auto make_payload(std::in_place_type_t<T> type, Args &&...args) -> payload_type
+        {
+            if constexpr (std::is_same_v<T, DOCTYPEToken>)
+                return payload_type { std::in_place_type<doctype_box>, std::make_unique<DOCTYPEToken>(std::forward<Args>(args)...) };
+            else
+                return payload_type { type, std::forward<Args>(args)... };
+        }
+
+        // Mutable as the tokens given by the tokenizer can be modified by the parser
+        mutable payload_type payload;
+    };
+
+    /// \brief Buffer of the kept tokens
+    /// \note It is not allocated from the pool: the pool backs every size with a block of 1000 chunks of it, so the buffer of a
+    /// \note large document would need blocks of gigabytes
+    using token_vector = std::vector<token_record>;
 
 } // namespace scrp
 
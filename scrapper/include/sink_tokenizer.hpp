@@ -0,0 +1,180 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 06/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_SINK_TOKENIZER_HPP
+#define WBSCRP_SINK_TOKENIZER_HPP
+
+#include <concepts>
+#include <string_view>
+
+#include "tokenizer.hpp"
+
+namespace scrp
+{
+    template <typename Sink>
+    concept sink_handles_doctype = requires(Sink &sink, const DOCTYPEToken &doctype) { sink.on_doctype(doctype); };
+    template <typename Sink>
+    concept sink_handles_tag = requires(Sink &sink, const TagToken &tag, std::string_view source) { sink.on_tag(tag, source); };
+    template <typename Sink>
+    concept sink_handles_end_tag = requires(Sink &sink, const TagToken &tag, std::string_view source) { sink.on_end_tag(tag, source); };
+    template <typename Sink>
+    concept sink_handles_text = requires(Sink &sink, std::string_view text) { sink.on_text(text); };
+    template <typename Sink>
+    concept sink_handles_comment = requires(Sink &sink, std::string_view comment) { sink.on_comment(comment); };
+    template <typename Sink>
+    concept sink_handles_cdata = requires(Sink &sink, std::string_view cdata) { sink.on_cdata(cdata); };
+    template <typename Sink>
+    concept sink_handles_eof = requires(Sink &sink) { sink.on_eof(); };
+    template <typename Sink>
+    concept sink_can_stop = requires(const Sink &sink) { { sink.done() } -> std::convertible_to<bool>; };
+
+    /// \brief A type with at least one of the handlers:
+    /// \brief on_doctype(const DOCTYPEToken &), on_tag(const TagToken &, std::string_view source),
+    /// \brief on_end_tag(const TagToken &, std::string_view source), on_text(std::string_view),
+    /// \brief on_comment(std::string_view), on_cdata(std::string_view), on_eof()
+    template <typename Sink>
+    concept token_sink = sink_handles_doctype<Sink> || sink_handles_tag<Sink> || sink_handles_end_tag<Sink>
+                      || sink_handles_text<Sink> || sink_handles_comment<Sink> || sink_handles_cdata<Sink>
+                      || sink_handles_eof<Sink>;
+
+    /// \brief Tokenizer front-end that gives every token to the handlers of Sink
+    /// \brief The handlers are resolved at compile time, so they can be inlined; tokens of a type without a handler are skipped
+    /// \note Tokens are taken with Tokenizer::next(); no parser is involved. Text and comments are given as views that are
+    /// \note valid only during the call, and source is the view the spans of a tag refer to
+    /// \note on_eof() is called once at the end of every input
+    /// \note A sink with a done() member that returns true once it has every token it needs stops the tokenizer right after
+    /// \note the handler that made it so; on_eof() is not called then. See Tokenizer::stop()
+    template <token_sink Sink>
+    class sink_tokenizer
+    {
+    public:
+        explicit sink_tokenizer(Sink &sink) :
+            _sink { &sink } { }
+
+    public:
+        /// \brief Tokenizes source, calling the handlers of the sink for each token
+        /// \return false if source is empty
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        auto tokenize(sc_string source) -> bool
+        {
+            if (source.empty())
+                return false;
+
+            _tokenizer.reset(std::move(source));
+            run();
+            return true;
+        }
+
+        /// \brief Tokenizes a mapped file in place, calling the handlers of the sink for each token
+        /// \return false if the file is empty
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        auto tokenize(mapped_file input) -> bool
+        {
+            if (input.empty())
+                return false;
+
+            _tokenizer.reset(std::move(input));
+            run();
+            return true;
+        }
+
+        /// \brief Tokenizes source in place, without copying it, calling the handlers of the sink for each token
+        /// \return false if source is empty
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        auto tokenize_view(std::string_view source) -> bool
+        {
+            if (source.empty())
+                return false;
+
+            _tokenizer.reset_view(source);
+            run();
+            return true;
+        }
+
+        /// \brief Handlers of sink are called from the next input on
+        auto set_sink(Sink &sink) noexcept -> void
+        {
+            _sink = &sink;
+        }
+
+        /// \return The underlying tokenizer, to set its flags or to get its errors
+        [[nodiscard]] auto tokenizer() noexcept -> Tokenizer &
+        {
+            return _tokenizer;
+        }
+
+    private:
+        auto run() -> void
+        {
+            const auto source = _tokenizer.source();
+            bool end_of_file  = false;
+
+            while (Token *token = _tokenizer.next())
+            {
+                switch (token->type)
+                {
+                    case TokenType::DOCTYPE:
+                        if constexpr (sink_handles_doctype<Sink>)
+                            _sink->on_doctype(*Tokenizer::doctype_token_cast(token));
+                        break;
+                    case TokenType::Tag:
+                        if constexpr (sink_handles_tag<Sink>)
+                            _sink->on_tag(*Tokenizer::tag_token_cast(token), source);
+                        break;
+                    case TokenType::EndTag:
+                        if constexpr (sink_handles_end_tag<Sink>)
+                            _sink->on_end_tag(*Tokenizer::tag_token_cast(token), source);
+                        break;
+                    case TokenType::Character:
+                        if constexpr (sink_handles_text<Sink>)
+                            _sink->on_text(Tokenizer::character_token_cast(token)->view(source));
+                        break;
+                    case TokenType::Comment:
+                        if constexpr (sink_handles_comment<Sink>)
+                            _sink->on_comment(Tokenizer::comment_token_cast(token)->view(source));
+                        break;
+                    case TokenType::CDATA:
+                        if constexpr (sink_handles_cdata<Sink>)
+                            _sink->on_cdata(Tokenizer::cdata_token_cast(token)->cdata);
+                        break;
+                    case TokenType::EndOfFile:
+                        end_of_file = true;
+                        if constexpr (sink_handles_eof<Sink>)
+                            _sink->on_eof();
+                        break;
+                }
+
+                if constexpr (sink_can_stop<Sink>)
+                {
+                    if (_sink->done())
+                    {
+                        _tokenizer.stop();
+                        return;
+                    }
+                }
+            }
+
+            // The tokenizer gives no EOF token when the input ends right after a tag
+            if constexpr (sink_handles_eof<Sink>)
+            {
+                if (!end_of_file)
+                    _sink->on_eof();
+            }
+        }
+
+    private:
+        Sink *_sink;
+        Tokenizer _tokenizer;
+    };
+} // namespace scrp
+
+#endif // WBSCRP_SINK_TOKENIZER_HPP
@@ -0,0 +1,238 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 04/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#pragma once
+
+#ifndef __cplusplus
+#error "C++ compiler needed"
+#endif /*__cplusplus*/
+
+#ifndef WBSCRP_SMALL_VECTOR_HPP
+#define WBSCRP_SMALL_VECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace scrp
+{
+    /// \brief Vector that keeps up to N elements inside the object and only allocates with Allocator beyond that
+    /// \note Moving a small_vector that uses the inline storage moves the elements one by one
+    template <typename T, std::size_t N, typename Allocator>
+    class small_vector
+    {
+        static_assert(N > 0);
+
+    public:
+        using value_type     = T;
+        using size_type      = std::size_t;
+        using iterator       = T *;
+        using const_iterator = const T *;
+
+        small_vector() noexcept = default;
+
+        small_vector(const small_vector &other)
+        {
+            reserve(other._size);
+            std::uninitialized_copy(other.begin(), other.end(), _data);
+            _size = other._size;
+        }
+
+        small_vector(small_vector &&other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        {
+            take(std::move(other));
+        }
+
+        ~small_vector()
+        {
+            clear();
+            deallocate();
+        }
+
+        auto operator=(const small_vector &other) -> small_vector &
+        {
+            if (this != &other)
+            {
+                clear();
+                reserve(other._size);
+                std::uninitialized_copy(other.begin(), other.end(), _data);
+                _size = other._size;
+            }
+            return *this;
+        }
+
+        auto operator=(small_vector &&other) noexcept(std::is_nothrow_move_constructible_v<T>) -> small_vector &
+        {
+            if (this != &other)
+            {
+                clear();
+                deallocate();
+                take(std::move(other));
+            }
+            return *this;
+        }
+
+    public:
+        template <typename... Args>
+        auto emplace_back(Args &&...args) -> T &
+        {
+            if (_size == _capacity)
+                reserve(_capacity * 2);
+
+            auto *element = std::construct_at(_data + _size, std::forward<Args>(args)...);
+            ++_size;
+            return *element;
+        }
+
+        auto push_back(const T &value) -> void
+        {
+            emplace_back(value);
+        }
+
+        auto push_back(T &&value) -> void
+        {
+            emplace_back(std::move(value));
+        }
+
+        /// \brief Destroys the elements; the storage is kept
+        auto clear() noexcept -> void
+        {
+            std::destroy(_data, _data + _size);
+            _size = 0;
+        }
+
+        auto reserve(size_type capacity) -> void
+        {
+            if (capacity <= _capacity)
+                return;
+
+            Allocator allocator;
+            T *storage = std::allocator_traits<Allocator>::allocate(allocator, capacity);
+            std::uninitialized_move(_data, _data + _size, storage);
+            std::destroy(_data, _data + _size);
+            deallocate();
+
+            _data     = storage;
+            _capacity = capacity;
+        }
+
+        [[nodiscard]] auto size() const noexcept -> size_type
+        {
+            return _size;
+        }
+
+        [[nodiscard]] auto capacity() const noexcept -> size_type
+        {
+            return _capacity;
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return _size == 0;
+        }
+
+        /// \return true if the elements are in the inline storage
+        [[nodiscard]] auto is_inline() const noexcept -> bool
+        {
+            return _data == inline_data();
+        }
+
+        [[nodiscard]] auto operator[](size_type index) noexcept -> T &
+        {
+            return _data[index];
+        }
+
+        [[nodiscard]] auto operator[](size_type index) const noexcept -> const T &
+        {
+            return _data[index];
+        }
+
+        [[nodiscard]] auto back() noexcept -> T &
+        {
+            return _data[_size - 1];
+        }
+
+        [[nodiscard]] auto back() const noexcept -> const T &
+        {
+            return _data[_size - 1];
+        }
+
+        [[nodiscard]] auto begin() noexcept -> iterator
+        {
+            return _data;
+        }
+
+        [[nodiscard]] auto end() noexcept -> iterator
+        {
+            return _data + _size;
+        }
+
+        [[nodiscard]] auto begin() const noexcept -> const_iterator
+        {
+            return _data;
+        }
+
+        [[nodiscard]] auto end() const noexcept -> const_iterator
+        {
+            return _data + _size;
+        }
+
+    private:
+        [[nodiscard]] auto inline_data() noexcept -> T *
+        {
+            return std::launder(reinterpret_cast<T *>(_inline));
+        }
+
+        [[nodiscard]] auto inline_data() const noexcept -> const T *
+        {
+            return std::launder(reinterpret_cast<const T *>(_inline));
+        }
+
+        auto deallocate() noexcept -> void
+        {
+            if (!is_inline())
+            {
+                Allocator allocator;
+                std::allocator_traits<Allocator>::deallocate(allocator, _data, _capacity);
+            }
+
+            _data     = inline_data();
+            _capacity = N;
+        }
+
+        // Requires this to be empty and to use the inline storage
+        auto take(small_vector &&other) noexcept(std::is_nothrow_move_constructible_v<T>) -> void
+        {
+            if (other.is_inline())
+            {
+                std::uninitialized_move(other.begin(), other.end(), _data);
+                _size = other._size;
+                other.clear();
+                return;
+            }
+
+            // Steal the allocated storage
+            _data     = other._data;
+            _size     = other._size;
+            _capacity = other._capacity;
+
+            other._data     = other.inline_data();
+            other._size     = 0;
+            other._capacity = N;
+        }
+
+    private:
+        alignas(T) std::byte _inline[N * sizeof(T)];
+        T *_data { inline_data() };
+        size_type _size { 0 };
+        size_type _capacity { N };
+    };
+} // namespace scrp
+
+#endif // WBSCRP_SMALL_VECTOR_HPP
@@ -13,26 +13,139 @@
 #ifndef WBSCRP_TOKENIZER_HPP
 #define WBSCRP_TOKENIZER_HPP
 
+#include "mapped_file.hpp"
 #include "parser_error.hpp"
 #include "scrapper.hpp"
+#include <initializer_list>
+#include <span>
 
 namespace scrp
 {
     class parser;
     enum class States;
+    struct token_buffer;
+
+    /// \brief Position of a character in the input being tokenized
+    using input_iterator = const char_type *;
+
+    /// \brief Which parse errors a tokenizer keeps
+    enum class error_policy
+    {
+        off,   // errors are neither kept nor counted
+        count, // errors are only counted
+        first, // the first ones are kept, up to the limit given to Tokenizer::set_error_policy(); every one is counted
+        all,   // default
+    };
+
+    /// \brief Outcome of Tokenizer::try_tokenize()
+    enum class tokenize_status
+    {
+        done,          // the input was tokenized; the recoverable errors are given by get_parse_errors()
+        empty,         // no input was given
+        stopped,       // stop() was called before the end of the input
+        over_budget,   // more tokens or errors than the budget would have been kept; the ones given are valid
+        out_of_memory, // an allocation failed; the tokens given are valid
+        failed,        // the parser threw
+    };
+
     class Tokenizer
     {
     public:
+        /// \brief Creates a tokenizer whose input is given with feed()
+        Tokenizer();
         explicit Tokenizer(sc_string source);
+        /// \brief Tokenizes the contents of a mapped file in place, without copying it
+        /// \note The tokenizer owns the mapping; spans of the tokens refer to the mapped memory
+        explicit Tokenizer(mapped_file input);
         ~Tokenizer();
 
     public:
+        /// \brief Starts over with a new input, as a new tokenizer would, without releasing the allocated buffers
+        /// \brief The parser, the flags set with keep_tokens() or use_source_spans() and the tag interest set are kept
+        /// \param source The new input. If it is empty, the input is given with feed()
+        /// \param max_capacity Buffers that grew beyond this number of elements are released. 0 keeps every buffer
+        /// \note Tokens, spans and errors of the previous input are invalidated
+        auto reset(sc_string source, std::size_t max_capacity = 0) -> void;
+        auto reset(mapped_file input, std::size_t max_capacity = 0) -> void;
+        /// \brief Same as reset(), but source is tokenized in place, without copying it
+        /// \note The memory of source must outlive the tokens; their spans refer to it
+        auto reset_view(std::string_view source, std::size_t max_capacity = 0) -> void;
+
         /// \return true if no errors were encounter; false if recoverable parsing errors were encounter. Retrieve this errors with get_parse_errors();
         /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
         [[nodiscard]] auto tokenize() -> bool;
 
+        /// \brief Same as tokenize(), but failures are given as a status instead of exceptions
+        /// \param budget If not 0, the buffers of the kept tokens and of the errors are reserved for budget elements before the first
+        /// \param budget character, and the tokenization stops instead of growing them past it: no allocation of theirs happens in the
+        /// \param budget loop unless the budget is larger than the reservations of the tokenizer (65536 tokens, 2048 errors)
+        /// \return tokenize_status::done once the whole input is tokenized
+        /// \note After a status other than done or empty the tokenizer is stopped; reset() starts over with a new input
+        [[nodiscard]] auto try_tokenize(std::size_t budget = 0) noexcept -> tokenize_status;
+
+        /// \brief Tokenizes a large input on up to threads threads
+        /// \brief The input is split in segments before tags that start a line, and the segments of a wave, one per thread, are
+        /// \brief tokenized at the same time as if each of them started in the data state. A sequential pass keeps a segment only if
+        /// \brief the input before it ended in the data state right at the split; otherwise the segment is tokenized again after the
+        /// \brief input before it
+        /// \param threads Number of threads, the calling one included. 0 uses one per hardware thread
+        /// \param segment_size Approximate size of the segments. Every thread keeps the tokens of one segment until it is checked
+        /// \return Same as tokenize()
+        /// \note Tokens and errors are the same as those of tokenize(), but they are given to the parser in batches, once the
+        /// \note segments that hold them are checked
+        /// \note Only for an input given to the constructor or to reset()
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        [[nodiscard]] auto tokenize_parallel(std::size_t threads = 0, std::size_t segment_size = 1 << 16) -> bool;
+
+        /// \brief Appends chunk to the input and tokenizes as much of it as possible
+        /// \brief The state of the tokenizer and the token being built are kept until the next call
+        /// \note A few characters are held back until more input is given or finish() is called
+        /// \note Consumed input is discarded unless use_source_spans() is set
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        auto feed(std::string_view chunk) -> void;
+
+        /// \brief Tokenizes the remaining input and handles the end of file
+        /// \return true if no errors were encounter; false if no input was given. Retrieve the errors with get_parse_errors();
+        /// \note Calling feed() after finish() or tokenize() will incur in undefined behavior
+        /// \throws scrp::parser_error if an unrecoverable parse_error is encounter
+        [[nodiscard]] auto finish() -> bool;
+
+        /// \brief Runs the tokenizer until the next token is available
+        /// \return The next token or nullptr once the input is exhausted
+        /// \note Tokens are only given by this function when no parser is set
+        /// \note The token is valid until the next call. It is released then unless keep_tokens() is set
+        /// \note The input given to the constructor or with feed() is treated as complete
+        [[nodiscard]] auto next() -> Token *;
+
+        /// \brief Ends the tokenization of the current input at the token being given
+        /// \brief tokenize() and finish() return as soon as the state machine gets back control, feed() ignores its input and
+        /// \brief next() gives no more tokens. The rest of the input is not looked at and the end of file is not handled
+        /// \note Meant to be called by a parser, a sink or the caller of next() once it has every token it needs
+        /// \note Text after the last token given is dropped. reset() starts over with a new input
+        auto stop() noexcept -> void;
+
+        /// \return true if stop() was called for the current input
+        [[nodiscard]] auto stopped() const noexcept -> bool;
+
+        /// \return A copy of the errors kept, with their lines and columns
         [[nodiscard]] auto get_parse_errors() const noexcept -> scrp::sc_vector<parser_error>;
 
+        /// \return The errors kept, without copying them. Valid until the tokenizer runs again or is reset
+        [[nodiscard]] auto parse_errors() const noexcept -> std::span<const error_record>;
+
+        /// \return Number of errors found, the ones the error policy did not keep included. 0 with error_policy::off
+        [[nodiscard]] auto error_count() const noexcept -> std::size_t;
+
+        /// \brief Computes the line and the column of error; only the line breaks before it are looked for
+        [[nodiscard]] auto describe_error(const error_record &error) const -> parser_error;
+
+        /// \brief Chooses which parse errors are kept. It is kept by reset()
+        /// \param limit Number of errors kept with error_policy::first
+        /// \note If this is set while the tokenizer is running, it will incur in undefined behavior
+        auto set_error_policy(error_policy policy, std::size_t limit = 0) -> void;
+
+        /// \brief Tokens are passed to parser as soon as they are emitted
+        /// \note Without a parser, tokens must be retrieved with next()
         auto set_parser(parser *parser) -> void;
 
         /// \brief Once a token is passed to the parser is discarded.
@@ -45,70 +158,107 @@ namespace scrp
         /// \note If this flag is set while the tokenizer is running, it will incur in undefined behavior
         auto keep_tokens() -> void;
 
-        [[nodiscard]] auto tokens() const -> const sc_vector<Token *> &;
+        /// \note Tokens are stored by value; pointers to them are invalidated when more tokens are emitted
+        [[nodiscard]] auto tokens() const -> const token_vector &;
+
+        /// \brief Character, comment and tag name payloads, as well as attribute names and values, are given as
+        /// \brief spans into source() and an owned string is only built when the text differs from the source
+        /// \note If this flag is set while the tokenizer is running, it will incur in undefined behavior
+        auto use_source_spans() -> void;
+
+        /// \brief Every token payload is copied into an owned string
+        /// \note This is default behavior
+        /// \note If this flag is set while the tokenizer is running, it will incur in undefined behavior
+        auto use_owned_strings() -> void;
+
+        /// \brief Only the start and end tags named in names are given. The others are still tokenized, but their attributes
+        /// \brief are skipped: neither stored nor decoded, and no token is built for them
+        /// \param names Tag names, compared in lower case. An empty set gives every tag, which is the default behavior
+        /// \note Text elements such as script or textarea switch the state of the tokenizer whether they are given or not
+        /// \note Errors about the attributes of skipped tags (duplicate-attribute, end-tag-with-attributes and the errors of
+        /// \note character references) are not reported
+        /// \note If the set is changed while the tokenizer is running, it will incur in undefined behavior
+        auto set_tag_interest(std::span<const std::string_view> names) -> void;
+        auto set_tag_interest(std::initializer_list<std::string_view> names) -> void;
+
+        /// \return The text being tokenized. Spans of the tokens refer to this view
+        /// \note The view is invalidated by feed()
+        [[nodiscard]] auto source() const noexcept -> std::string_view;
 
     protected:
         auto handle_eof_error(States stateChange) -> void;
-        auto data_state(sc_string::iterator &pos, States &stateChange) -> void;
-        auto character_reference(sc_string::iterator &pos, States &stateChange) -> void;
-        auto named_character_reference(sc_string::iterator &pos, States &stateChange) -> void;
-        auto numeric_character_reference(sc_string::iterator &pos, States &stateChange) -> void;
-        auto hexadecimal_character_reference_start(sc_string::iterator &pos, States &stateChange) -> void;
-        auto decimal_character_reference_start(sc_string::iterator &pos, States &stateChange) -> void;
-        auto hexadecimal_character_reference(sc_string::iterator &pos, States &stateChange) -> void;
-        auto decimal_character_reference(sc_string::iterator &pos, States &stateChange) -> void;
-        auto numeric_character_reference_end(sc_string::iterator &pos, States &stateChange) -> void;
-        auto ambiguous_ampersand(sc_string::iterator &pos, States &stateChange) -> void;
-        auto tag_open_state(sc_string::iterator &pos, States &stateChange) -> void;
-        auto markup_declaration_open(sc_string::iterator &pos, States &stateChange) -> void;
-        auto bogus_comment(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_start(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_start_dash(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_end(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_less_than_sign(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_end_dash(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_less_than_sign_bang(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_less_than_sign_bang_dash(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_less_than_sign_bang_dash_dash(sc_string::iterator &pos, States &stateChange) -> void;
-        auto comment_end_bang(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype(sc_string::iterator &pos, States &stateChange) -> void;
-        auto before_doctype_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_doctype_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_doctype_public_keyword(sc_string::iterator &pos, States &stateChange) -> void;
-        auto before_doctype_public_identifier(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype_public_identifier_dq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype_public_identifier_sq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_doctype_public_identifier(sc_string::iterator &pos, States &stateChange) -> void;
-        auto between_doctype_public_and_system_identifiers(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_doctype_system_keyword(sc_string::iterator &pos, States &stateChange) -> void;
-        auto before_doctype_system_identifier(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype_system_identifier_dq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto doctype_system_identifier_sq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_doctype_system_identifier(sc_string::iterator &pos, States &stateChange) -> void;
-        auto bogus_doctype(sc_string::iterator &pos, States &stateChange) -> void;
-        auto cdata_section(sc_string::iterator &pos, States &stateChange) -> void;
-        auto cdata_section_bracket(sc_string::iterator &pos, States &stateChange) -> void;
-        auto cdata_section_end(sc_string::iterator &pos, States &stateChange) -> void;
-        auto end_tag_open(sc_string::iterator &pos, States &stateChange) -> void;
-        auto tag_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto before_attribute_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto attribute_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_attribute_name(sc_string::iterator &pos, States &stateChange) -> void;
-        auto before_attribute_value(sc_string::iterator &pos, States &stateChange) -> void;
-        auto attribute_value_dq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto attribute_value_sq(sc_string::iterator &pos, States &stateChange) -> void;
-        auto attribute_value_unquoted(sc_string::iterator &pos, States &stateChange) -> void;
-        auto after_attribute_value_quoted(sc_string::iterator &pos, States &stateChange) -> void;
-        auto self_closing_start_tag(sc_string::iterator &pos, States &stateChange) -> void;
+        auto data_state(input_iterator &pos, States &stateChange) -> void;
+        auto rcdata_state(input_iterator &pos, States &stateChange) -> void;
+        /// \brief RAWTEXT, script data and PLAINTEXT states
+        auto rawtext_state(input_iterator &pos, States &stateChange) -> void;
+        auto character_reference(input_iterator &pos, States &stateChange) -> void;
+        auto named_character_reference(input_iterator &pos, States &stateChange) -> void;
+        auto numeric_character_reference(input_iterator &pos, States &stateChange) -> void;
+        auto hexadecimal_character_reference_start(input_iterator &pos, States &stateChange) -> void;
+        auto decimal_character_reference_start(input_iterator &pos, States &stateChange) -> void;
+        auto hexadecimal_character_reference(input_iterator &pos, States &stateChange) -> void;
+        auto decimal_character_reference(input_iterator &pos, States &stateChange) -> void;
+        auto numeric_character_reference_end(input_iterator &pos, States &stateChange) -> void;
+        auto ambiguous_ampersand(input_iterator &pos, States &stateChange) -> void;
+        auto tag_open_state(input_iterator &pos, States &stateChange) -> void;
+        auto markup_declaration_open(input_iterator &pos, States &stateChange) -> void;
+        auto bogus_comment(input_iterator &pos, States &stateChange) -> void;
+        auto comment_start(input_iterator &pos, States &stateChange) -> void;
+        auto comment_start_dash(input_iterator &pos, States &stateChange) -> void;
+        auto comment(input_iterator &pos, States &stateChange) -> void;
+        auto comment_end(input_iterator &pos, States &stateChange) -> void;
+        auto comment_less_than_sign(input_iterator &pos, States &stateChange) -> void;
+        auto comment_end_dash(input_iterator &pos, States &stateChange) -> void;
+        auto comment_less_than_sign_bang(input_iterator &pos, States &stateChange) -> void;
+        auto comment_less_than_sign_bang_dash(input_iterator &pos, States &stateChange) -> void;
+        auto comment_less_than_sign_bang_dash_dash(input_iterator &pos, States &stateChange) -> void;
+        auto comment_end_bang(input_iterator &pos, States &stateChange) -> void;
+        auto doctype(input_iterator &pos, States &stateChange) -> void;
+        auto before_doctype_name(input_iterator &pos, States &stateChange) -> void;
+        auto doctype_name(input_iterator &pos, States &stateChange) -> void;
+        auto after_doctype_name(input_iterator &pos, States &stateChange) -> void;
+        auto after_doctype_public_keyword(input_iterator &pos, States &stateChange) -> void;
+        auto before_doctype_public_identifier(input_iterator &pos, States &stateChange) -> void;
+        auto doctype_public_identifier_dq(input_iterator &pos, States &stateChange) -> void;
+        auto doctype_public_identifier_sq(input_iterator &pos, States &stateChange) -> void;
+        auto after_doctype_public_identifier(input_iterator &pos, States &stateChange) -> void;
+        auto between_doctype_public_and_system_identifiers(input_iterator &pos, States &stateChange) -> void;
+        auto after_doctype_system_keyword(input_iterator &pos, States &stateChange) -> void;
+        auto before_doctype_system_identifier(input_iterator &pos, States &stateChange) -> void;
+        auto doctype_system_identifier_dq(input_iterator &pos, States &stateChange) -> void;
+        auto doctype_system_identifier_sq(input_iterator &pos, States &stateChange) -> void;
+        auto after_doctype_system_identifier(input_iterator &pos, States &stateChange) -> void;
+        auto bogus_doctype(input_iterator &pos, States &stateChange) -> void;
+        auto cdata_section(input_iterator &pos, States &stateChange) -> void;
+        auto cdata_section_bracket(input_iterator &pos, States &stateChange) -> void;
+        auto cdata_section_end(input_iterator &pos, States &stateChange) -> void;
+        auto end_tag_open(input_iterator &pos, States &stateChange) -> void;
+        auto tag_name(input_iterator &pos, States &stateChange) -> void;
+        auto before_attribute_name(input_iterator &pos, States &stateChange) -> void;
+        auto attribute_name(input_iterator &pos, States &stateChange) -> void;
+        auto after_attribute_name(input_iterator &pos, States &stateChange) -> void;
+        auto before_attribute_value(input_iterator &pos, States &stateChange) -> void;
+        auto attribute_value_dq(input_iterator &pos, States &stateChange) -> void;
+        auto attribute_value_sq(input_iterator &pos, States &stateChange) -> void;
+        auto attribute_value_unquoted(input_iterator &pos, States &stateChange) -> void;
+        auto after_attribute_value_quoted(input_iterator &pos, States &stateChange) -> void;
+        auto self_closing_start_tag(input_iterator &pos, States &stateChange) -> void;
 
     protected:
-        auto insert_attribute(const sc_string &name, const sc_string &value) -> void;
-        inline auto insert_character_to_string(sc_string &name, const sc_string &str) -> void;
-        inline auto insert_character_to_string(sc_string &name, std::string_view str) -> void;
-        inline auto insert_character_to_string(sc_string &name, char_type ch) -> void;
-        [[nodiscard]] auto is_next_char_eof(const sc_string::iterator &pos) const -> bool;
+        auto insert_attribute(const token_buffer &name, const token_buffer &value) -> void;
+        inline auto insert_character_to_string(token_buffer &name, const sc_string &str) -> void;
+        inline auto insert_character_to_string(token_buffer &name, std::string_view str) -> void;
+        inline auto insert_character_to_string(token_buffer &name, char_type ch) -> void;
+        /// \brief Inserts ch, the value of the source character at pos, keeping the span of the buffer when possible
+        inline auto insert_source_character(token_buffer &name, const input_iterator &pos, char_type ch) -> void;
+        /// \brief Inserts the character at pos and the run of characters after it that have none of the delimiters classes
+        /// \brief nor are control characters, leaving pos at the last one
+        auto insert_source_run(token_buffer &name, input_iterator &pos, uint16_t delimiters) -> void;
+        /// \brief Same as insert_source_run() for a tag name or an attribute name, with the letters in lower case
+        auto insert_name_run(token_buffer &name, input_iterator &pos, bool attribute_name) -> void;
+        /// \brief Same as insert_source_run() for the attributes of a skipped tag: the run is stepped over, nothing is inserted
+        auto skip_source_run(input_iterator &pos, uint16_t delimiters) -> void;
+        [[nodiscard]] auto is_next_char_eof(const input_iterator &pos) const -> bool;
         [[nodiscard]] static auto is_char_alpha(scrp::char_type ch) noexcept -> bool;
         [[nodiscard]] static auto is_char_lower_alpha(scrp::char_type ch) noexcept -> bool;
         [[nodiscard]] static auto is_char_upper_alpha(scrp::char_type ch) noexcept -> bool;
@@ -117,13 +267,21 @@ namespace scrp
         [[nodiscard]] static auto is_char_hex_digit(scrp::char_type ch) noexcept -> bool;
         [[nodiscard]] static auto is_char_digit(scrp::char_type ch) noexcept -> bool;
         [[nodiscard]] static auto is_char_alphanumeric(scrp::char_type ch) noexcept -> bool;
+        [[nodiscard]] static auto is_char_control(scrp::char_type ch) noexcept -> bool;
         [[nodiscard]] static auto is_noncharacter(int64_t codepoint) noexcept -> bool;
         [[nodiscard]] static auto is_control_character(int64_t codepoint) noexcept -> bool;
         [[nodiscard]] static auto to_lower(scrp::char_type ch) noexcept -> scrp::char_type;
-        [[nodiscard]] static auto string_to_lower(sc_string &str) noexcept -> sc_string;
+        [[nodiscard]] static auto string_to_lower(sc_string &str) -> sc_string;
+        /// \brief Compares the input at pos with keyword, which must be lower case if ignore_case is true
+        /// \return The number of characters that match before the first difference or the end of the buffer
+        [[nodiscard]] auto match_keyword(const input_iterator &pos, std::string_view keyword, bool ignore_case) const noexcept -> std::size_t;
 
     protected:
         [[nodiscard]] auto is_return_state_attribute() -> bool;
+        /// \brief Flushes the ampersand that started a character reference to the attribute value or as a character token
+        auto flush_ampersand() -> void;
+        /// \return The return state of the character reference, which is removed from the state stack
+        auto leave_character_reference() -> States;
 
     protected:
         [[nodiscard]] auto current_position() const noexcept -> std::size_t;
@@ -131,14 +289,19 @@ namespace scrp
         [[nodiscard]] auto current_line_offset() const noexcept -> std::size_t;
 
     protected:
-        auto emit_token(Token *token) noexcept -> void;
-        auto emit_error(parser_error_type type) noexcept -> void;
+        auto emit_token(token_record &&token) -> void;
+        auto emit_error(parser_error_type type) -> void;
         auto emit_end_tag_token() -> void;
+        auto emit_character_run(const input_iterator &first, std::size_t length) -> void;
+        /// \brief Emits text as characters; it is appended to the pending character token if there is one
+        auto emit_characters(std::string_view text) -> void;
+        auto emit_current_comment_token() -> void;
+        auto emit_current_tag_token(bool self_closing = false) -> void;
 
         template <typename T, typename... Args>
-        auto emit_token(Args... args) -> void
+        auto emit_token(Args &&...args) -> void
         {
-            emit_token(get_token_pool<T>()->alloc(args...));
+            emit_token(token_record { std::in_place_type<T>, std::forward<Args>(args)... });
         }
 
         auto emit_eof_token()
@@ -152,12 +315,6 @@ namespace scrp
             emit_token<CommentToken>(std::forward<Args>(args)...);
         }
 
-        template <typename... Args>
-        auto emit_character_token(Args... args)
-        {
-            emit_token<CharacterToken>(std::forward<Args>(args)...);
-        }
-
         template <typename... Args>
         auto emit_doctype_token(Args... args)
         {
@@ -215,7 +372,12 @@ namespace scrp
 
 
     private:
-        auto release_token(Token *&) -> void;
+        /// \brief Runs the state machine from the last consumed character up to the character at limit
+        auto run(std::size_t limit) -> void;
+        /// \brief Handles the end of file and delivers the remaining tokens. Does nothing the second time is called
+        auto end_of_file() -> void;
+        /// \brief Passes the token to the parser or queues it for next()
+        auto deliver_token(token_record &token) -> void;
 
     private:
         struct Impl;
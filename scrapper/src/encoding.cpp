@@ -44,6 +44,25 @@ const scrp::encoding::character_reference &scrp::encoding::find_reference(std::s
     return null_chref;
 }
 
+auto scrp::encoding::match_reference(std::string_view input) noexcept -> reference_match
+{
+    reference_match match;
+
+    uint16_t node = chref_trie_root;
+    for (std::size_t i = 0; i < input.size(); ++i)
+    {
+        const auto next = chref_trie_step(node, input[i]);
+        if (next == chref_trie_no_node)
+            break;
+
+        node = static_cast<uint16_t>(next);
+        if (const auto reference = chref_trie_nodes[node].reference; reference >= 0)
+            match = { &chref_table[static_cast<std::size_t>(reference)], i + 1 };
+    }
+
+    return match;
+}
+
 auto scrp::encoding:: rt_to_utf8(uint32_t utf16) -> utf8_pair
 {
     if (utf16 < 0x007F)
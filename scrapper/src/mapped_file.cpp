@@ -0,0 +1,134 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 05/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WBSCRP_MAPPED_FILE_MMAP
+#else
+#include <fstream>
+#endif
+
+#ifdef WBSCRP_MAPPED_FILE_MMAP
+
+scrp::mapped_file::mapped_file(const std::filesystem::path &path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::system_error(errno, std::generic_category(), path.string());
+
+    struct stat info { };
+    if (::fstat(fd, &info) == -1)
+    {
+        const auto error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path.string());
+    }
+
+    // An empty file can not be mapped; it is an empty view
+    if (info.st_size > 0)
+    {
+        const auto size = static_cast<std::size_t>(info.st_size);
+        void *address    = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            const auto error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path.string());
+        }
+
+        // The tokenizer reads the input once from the start to the end
+        ::madvise(address, size, MADV_SEQUENTIAL);
+
+        _data = static_cast<const char *>(address);
+        _size = size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+auto scrp::mapped_file::unmap() noexcept -> void
+{
+    if (_data != nullptr)
+        ::munmap(const_cast<char *>(_data), _size);
+
+    _data = nullptr;
+    _size = 0;
+}
+
+#else
+
+scrp::mapped_file::mapped_file(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), path.string());
+
+    const auto size = static_cast<std::size_t>(std::filesystem::file_size(path));
+    _copy           = std::make_unique<char[]>(size);
+    if (!file.read(_copy.get(), static_cast<std::streamsize>(size)))
+        throw std::system_error(std::make_error_code(std::errc::io_error), path.string());
+
+    _data = _copy.get();
+    _size = size;
+}
+
+auto scrp::mapped_file::unmap() noexcept -> void
+{
+    _copy.reset();
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif /*WBSCRP_MAPPED_FILE_MMAP*/
+
+scrp::mapped_file::mapped_file(mapped_file &&other) noexcept :
+    _data { std::exchange(other._data, nullptr) },
+    _size { std::exchange(other._size, 0) },
+    _copy { std::move(other._copy) }
+{
+}
+
+auto scrp::mapped_file::operator=(mapped_file &&other) noexcept -> mapped_file &
+{
+    if (this != &other)
+    {
+        unmap();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _copy = std::move(other._copy);
+    }
+    return *this;
+}
+
+scrp::mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+auto scrp::mapped_file::view() const noexcept -> std::string_view
+{
+    return { _data, _size };
+}
+
+auto scrp::mapped_file::size() const noexcept -> std::size_t
+{
+    return _size;
+}
+
+auto scrp::mapped_file::empty() const noexcept -> bool
+{
+    return _size == 0;
+}
@@ -0,0 +1,363 @@
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// Created by Ricardo Romero on 02/02/23.
+// Copyright (c) 2023 Ricardo Romero.  All rights reserved.
+//
+
+#include "scanner.hpp"
+
+#include <bit>
+
+#if !defined(USE_UTF16) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#define WBSCRP_SCANNER_SIMD
+#endif
+
+auto scrp::scanner::find_data_delimiter_scalar(const char_type *first, const char_type *last) noexcept -> const char_type *
+{
+    for (; first != last; ++first)
+    {
+        switch (*first)
+        {
+            case '<':
+            case '&':
+            case 0:
+                return first;
+            default:;
+        }
+    }
+
+    return last;
+}
+
+auto scrp::scanner::find_data_delimiter(const char_type *first, const char_type *last) noexcept -> const char_type *
+{
+#ifdef WBSCRP_SCANNER_SIMD
+
+#ifdef __AVX2__
+    {
+        const __m256i _lt   = _mm256_set1_epi8('<');
+        const __m256i _amp  = _mm256_set1_epi8('&');
+        const __m256i _null = _mm256_setzero_si256();
+
+        for (; last - first >= 32; first += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+
+            const __m256i match = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, _lt), _mm256_cmpeq_epi8(block, _amp)),
+                _mm256_cmpeq_epi8(block, _null));
+
+            if (const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+#endif /*__AVX2__*/
+
+    {
+        const __m128i _lt   = _mm_set1_epi8('<');
+        const __m128i _amp  = _mm_set1_epi8('&');
+        const __m128i _null = _mm_setzero_si128();
+
+        for (; last - first >= 16; first += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+
+            const __m128i match = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _lt), _mm_cmpeq_epi8(block, _amp)),
+                _mm_cmpeq_epi8(block, _null));
+
+            if (const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+
+#endif /*WBSCRP_SCANNER_SIMD*/
+
+    return find_data_delimiter_scalar(first, last);
+}
+
+auto scrp::scanner::find_line_break_scalar(const char_type *first, const char_type *last) noexcept -> const char_type *
+{
+    for (; first != last; ++first)
+    {
+        if (*first == '\r' || *first == '\n')
+            return first;
+    }
+
+    return last;
+}
+
+auto scrp::scanner::find_line_break(const char_type *first, const char_type *last) noexcept -> const char_type *
+{
+#ifdef WBSCRP_SCANNER_SIMD
+
+#ifdef __AVX2__
+    {
+        const __m256i _cr = _mm256_set1_epi8('\r');
+        const __m256i _lf = _mm256_set1_epi8('\n');
+
+        for (; last - first >= 32; first += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+            const __m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(block, _cr), _mm256_cmpeq_epi8(block, _lf));
+
+            if (const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+#endif /*__AVX2__*/
+
+    {
+        const __m128i _cr = _mm_set1_epi8('\r');
+        const __m128i _lf = _mm_set1_epi8('\n');
+
+        for (; last - first >= 16; first += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+            const __m128i match = _mm_or_si128(_mm_cmpeq_epi8(block, _cr), _mm_cmpeq_epi8(block, _lf));
+
+            if (const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+
+#endif /*WBSCRP_SCANNER_SIMD*/
+
+    return find_line_break_scalar(first, last);
+}
+
+auto scrp::scanner::find_class(const char_type *first, const char_type *last, uint16_t mask) noexcept -> const char_type *
+{
+    for (; first != last; ++first)
+    {
+        if (has_class(*first, mask))
+            return first;
+    }
+
+    return last;
+}
+
+namespace
+{
+    // true if [candidate, end) starts with "</name" followed by a character that ends a tag name
+    auto is_end_tag(const scrp::char_type *candidate, const scrp::char_type *end, std::string_view name) noexcept -> bool
+    {
+        if (static_cast<std::size_t>(end - candidate) < name.size() + 3 || candidate[1] != '/')
+            return false;
+
+        const auto *tag_name = candidate + 2;
+        for (std::size_t i = 0; i < name.size(); ++i)
+        {
+            // Every name is made of ASCII letters and digits; 0x20 folds the case of the letters
+            if ((tag_name[i] | 0x20) != name[i])
+                return false;
+        }
+
+        switch (tag_name[name.size()])
+        {
+            case 0x09:
+            case 0x0A:
+            case 0x0C:
+            case 0x0D:
+            case 0x20:
+            case '/':
+            case '>':
+                return true;
+            default:
+                return false;
+        }
+    }
+} // namespace
+
+auto scrp::scanner::find_end_tag_scalar(const char_type *first, const char_type *last, const char_type *end, std::string_view name) noexcept -> const char_type *
+{
+    for (; first != last; ++first)
+    {
+        if (*first == '<' && is_end_tag(first, end, name))
+            return first;
+    }
+
+    return last;
+}
+
+auto scrp::scanner::find_end_tag(const char_type *first, const char_type *last, const char_type *end, std::string_view name) noexcept -> const char_type *
+{
+#ifdef WBSCRP_SCANNER_SIMD
+
+    // Candidates are positions with '<', '/' and the first letter of the name in a row; the rest is checked by is_end_tag()
+
+#ifdef __AVX2__
+    {
+        const __m256i _lt    = _mm256_set1_epi8('<');
+        const __m256i _slash = _mm256_set1_epi8('/');
+        const __m256i _case  = _mm256_set1_epi8(0x20);
+        const __m256i _first = _mm256_set1_epi8(name[0]);
+
+        for (; last - first >= 32 && end - first >= 34; first += 32)
+        {
+            const __m256i lt    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+            const __m256i slash = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + 1));
+            const __m256i ch    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + 2));
+
+            const __m256i match = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi8(lt, _lt), _mm256_cmpeq_epi8(slash, _slash)),
+                _mm256_cmpeq_epi8(_mm256_or_si256(ch, _case), _first));
+
+            for (auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match)); mask != 0; mask &= mask - 1)
+            {
+                const auto *candidate = first + std::countr_zero(mask);
+                if (is_end_tag(candidate, end, name))
+                    return candidate;
+            }
+        }
+    }
+#endif /*__AVX2__*/
+
+    {
+        const __m128i _lt    = _mm_set1_epi8('<');
+        const __m128i _slash = _mm_set1_epi8('/');
+        const __m128i _case  = _mm_set1_epi8(0x20);
+        const __m128i _first = _mm_set1_epi8(name[0]);
+
+        for (; last - first >= 16 && end - first >= 18; first += 16)
+        {
+            const __m128i lt    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+            const __m128i slash = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + 1));
+            const __m128i ch    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + 2));
+
+            const __m128i match = _mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(lt, _lt), _mm_cmpeq_epi8(slash, _slash)),
+                _mm_cmpeq_epi8(_mm_or_si128(ch, _case), _first));
+
+            for (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match)); mask != 0; mask &= mask - 1)
+            {
+                const auto *candidate = first + std::countr_zero(mask);
+                if (is_end_tag(candidate, end, name))
+                    return candidate;
+            }
+        }
+    }
+
+#endif /*WBSCRP_SCANNER_SIMD*/
+
+    return find_end_tag_scalar(first, last, end, name);
+}
+
+auto scrp::scanner::find_name_end_scalar(const char_type *first, const char_type *last, bool attribute_name) noexcept -> const char_type *
+{
+    return find_class(first, last, class_control | (attribute_name ? class_attribute_name_end : class_tag_name_end));
+}
+
+auto scrp::scanner::find_name_end(const char_type *first, const char_type *last, bool attribute_name) noexcept -> const char_type *
+{
+#ifdef WBSCRP_SCANNER_SIMD
+
+    // Control characters and whitespace are the bytes up to 0x20, compared without sign so the bytes of UTF-8 sequences pass.
+    // Attribute names also end at '=', '"', '\'' and '<'; tag names let those through by comparing them with '>'
+
+#ifdef __AVX2__
+    {
+        const __m256i _space = _mm256_set1_epi8(0x20);
+        const __m256i _del   = _mm256_set1_epi8(0x7F);
+        const __m256i _slash = _mm256_set1_epi8('/');
+        const __m256i _gt    = _mm256_set1_epi8('>');
+        const __m256i _eq    = _mm256_set1_epi8(attribute_name ? '=' : '>');
+        const __m256i _dq    = _mm256_set1_epi8(attribute_name ? '"' : '>');
+        const __m256i _sq    = _mm256_set1_epi8(attribute_name ? '\'' : '>');
+        const __m256i _lt    = _mm256_set1_epi8(attribute_name ? '<' : '>');
+
+        for (; last - first >= 32; first += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+
+            const __m256i control = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(block, _space), block), _mm256_cmpeq_epi8(block, _del));
+            const __m256i tag     = _mm256_or_si256(_mm256_cmpeq_epi8(block, _slash), _mm256_cmpeq_epi8(block, _gt));
+            const __m256i quote   = _mm256_or_si256(_mm256_cmpeq_epi8(block, _dq), _mm256_cmpeq_epi8(block, _sq));
+            const __m256i other   = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _eq), _mm256_cmpeq_epi8(block, _lt)), quote);
+            const __m256i match   = _mm256_or_si256(_mm256_or_si256(control, tag), other);
+
+            if (const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+#endif /*__AVX2__*/
+
+    {
+        const __m128i _space = _mm_set1_epi8(0x20);
+        const __m128i _del   = _mm_set1_epi8(0x7F);
+        const __m128i _slash = _mm_set1_epi8('/');
+        const __m128i _gt    = _mm_set1_epi8('>');
+        const __m128i _eq    = _mm_set1_epi8(attribute_name ? '=' : '>');
+        const __m128i _dq    = _mm_set1_epi8(attribute_name ? '"' : '>');
+        const __m128i _sq    = _mm_set1_epi8(attribute_name ? '\'' : '>');
+        const __m128i _lt    = _mm_set1_epi8(attribute_name ? '<' : '>');
+
+        for (; last - first >= 16; first += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+
+            const __m128i control = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(block, _space), block), _mm_cmpeq_epi8(block, _del));
+            const __m128i tag     = _mm_or_si128(_mm_cmpeq_epi8(block, _slash), _mm_cmpeq_epi8(block, _gt));
+            const __m128i quote   = _mm_or_si128(_mm_cmpeq_epi8(block, _dq), _mm_cmpeq_epi8(block, _sq));
+            const __m128i other   = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _eq), _mm_cmpeq_epi8(block, _lt)), quote);
+            const __m128i match   = _mm_or_si128(_mm_or_si128(control, tag), other);
+
+            if (const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match)); mask != 0)
+                return first + std::countr_zero(mask);
+        }
+    }
+
+#endif /*WBSCRP_SCANNER_SIMD*/
+
+    return find_name_end_scalar(first, last, attribute_name);
+}
+
+auto scrp::scanner::copy_lower_scalar(const char_type *first, const char_type *last, char_type *out) noexcept -> char_type *
+{
+    for (; first != last; ++first, ++out)
+        *out = to_lower(*first);
+
+    return out;
+}
+
+auto scrp::scanner::copy_lower(const char_type *first, const char_type *last, char_type *out) noexcept -> char_type *
+{
+#ifdef WBSCRP_SCANNER_SIMD
+
+    // The comparisons are signed: the bytes of UTF-8 sequences are negative and are never taken as upper case letters
+
+#ifdef __AVX2__
+    {
+        const __m256i _before_a = _mm256_set1_epi8('A' - 1);
+        const __m256i _after_z  = _mm256_set1_epi8('Z' + 1);
+        const __m256i _case     = _mm256_set1_epi8(0x20);
+
+        for (; last - first >= 32; first += 32, out += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+            const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, _before_a), _mm256_cmpgt_epi8(_after_z, block));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_or_si256(block, _mm256_and_si256(upper, _case)));
+        }
+    }
+#endif /*__AVX2__*/
+
+    {
+        const __m128i _before_a = _mm_set1_epi8('A' - 1);
+        const __m128i _after_z  = _mm_set1_epi8('Z' + 1);
+        const __m128i _case     = _mm_set1_epi8(0x20);
+
+        for (; last - first >= 16; first += 16, out += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+            const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _before_a), _mm_cmpgt_epi8(_after_z, block));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(block, _mm_and_si128(upper, _case)));
+        }
+    }
+
+#endif /*WBSCRP_SCANNER_SIMD*/
+
+    return copy_lower_scalar(first, last, out);
+}
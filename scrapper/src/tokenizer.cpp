@@ -7,10 +7,21 @@
 #include "tokenizer.hpp"
 
 #include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "encoding_character_reference.hpp"
 #include "parser.hpp"
+#include "scanner.hpp"
 
 namespace scrp
 {
@@ -56,6 +67,10 @@ namespace scrp
         DOCTYPESystemIdentifierSQ,
         AfterDOCTYPESystemIdentifier,
         BogusDOCTYPE,
+        RCDATA,
+        RAWTEXT,
+        ScriptData,
+        PLAINTEXT,
         CDATASection,
         CDATASectionBracket,
         CDATASectionEnd,
@@ -72,331 +87,1262 @@ namespace scrp
         AfterAttributeValueQuoted
     };
 
+    // The text being tokenized: an owned string, or a read-only view of memory owned by someone else (a mapped file).
+    // An external input is copied into storage the first time it has to be modified
+    struct input_buffer
+    {
+        explicit input_buffer(sc_string src) :
+            storage { std::move(src) }
+        {
+            refresh();
+        }
+
+        input_buffer(const input_buffer &)                     = delete;
+        auto operator=(const input_buffer &) -> input_buffer & = delete;
+
+        auto assign(sc_string src) -> void
+        {
+            storage  = std::move(src);
+            external = false;
+            refresh();
+        }
+
+        auto assign_external(std::string_view input) -> void
+        {
+            storage.clear();
+            external = true;
+            text     = input;
+        }
+
+        auto clear() noexcept -> void
+        {
+            storage.clear();
+            external = false;
+            refresh();
+        }
+
+        auto erase_front(std::size_t count) -> void
+        {
+            own();
+            storage.erase(0, count);
+            refresh();
+        }
+
+        auto append(std::string_view chunk) -> void
+        {
+            own();
+            storage.append(chunk.data(), chunk.size());
+            refresh();
+        }
+
+        [[nodiscard]] auto begin() const noexcept -> input_iterator
+        {
+            return text.data();
+        }
+
+        [[nodiscard]] auto end() const noexcept -> input_iterator
+        {
+            return text.data() + text.size();
+        }
+
+        [[nodiscard]] auto data() const noexcept -> const char_type *
+        {
+            return text.data();
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            return text.size();
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return text.empty();
+        }
+
+        [[nodiscard]] auto operator[](std::size_t index) const noexcept -> char_type
+        {
+            return text[index];
+        }
+
+        // NOLINTNEXTLINE(google-explicit-constructor)
+        operator std::string_view() const noexcept
+        {
+            return text;
+        }
+
+    private:
+        auto own() -> void
+        {
+            if (external)
+            {
+                storage.assign(text.data(), text.size());
+                external = false;
+            }
+        }
+
+        auto refresh() noexcept -> void
+        {
+            text = { storage.data(), storage.size() };
+        }
+
+    public:
+        sc_string storage;
+        std::string_view text;
+        bool external { false };
+    };
+
+    // Payload of the token being built. When spans are enabled, the text is kept as a span into the source
+    // for as long as every character appended is the next character of the source, and it is copied into text
+    // as soon as it diverges (character references, NUL replacement, case folding, skipped characters)
+    struct token_buffer
+    {
+        explicit token_buffer(const input_buffer &src) :
+            source { &src } { }
+
+        auto reserve(std::size_t size) -> void
+        {
+            text.reserve(size);
+        }
+
+        auto clear() noexcept -> void
+        {
+            text.clear();
+            span = {};
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return text.empty() && span.empty();
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            return text.size() + span.length;
+        }
+
+        [[nodiscard]] auto view() const noexcept -> std::string_view
+        {
+            return payload_view(*source, text, span);
+        }
+
+        // Owned copy of the payload regardless of the mode
+        [[nodiscard]] auto str() const -> sc_string
+        {
+            const auto v = view();
+            return { v.data(), v.size() };
+        }
+
+        auto append_source(std::size_t position, char_type ch) -> void
+        {
+            if (use_spans && text.empty() && (span.empty() || span.offset + span.length == position) && (*source)[position] == ch)
+            {
+                if (span.empty())
+                    span.offset = position;
+                ++span.length;
+                return;
+            }
+
+            append(ch);
+        }
+
+        // Same as append_source() for every character of run, which starts at position
+        auto append_source_run(std::size_t position, std::string_view run) -> void
+        {
+            if (use_spans && text.empty() && (span.empty() || span.offset + span.length == position))
+            {
+                if (span.empty())
+                    span.offset = position;
+                span.length += run.size();
+                return;
+            }
+
+            materialize();
+            text.append(run.data(), run.size());
+        }
+
+        auto append(char_type ch) -> void
+        {
+            materialize();
+            text += ch;
+        }
+
+        // Appends run with its ASCII letters in lower case
+        auto append_lower(std::string_view run) -> void
+        {
+            materialize();
+            const auto size = text.size();
+            text.resize(size + run.size());
+            scanner::copy_lower(run.data(), run.data() + run.size(), text.data() + size);
+        }
+
+        auto materialize() -> void
+        {
+            if (!span.empty())
+            {
+                text.assign(source->data() + span.offset, span.length);
+                span = {};
+            }
+        }
+
+        sc_string text;
+        source_span span;
+        const input_buffer *source;
+        bool use_spans { false };
+    };
+
+    // Elements whose contents are not markup, and the state that tokenizes the contents.
+    // These switches are made by the tree construction stage in the spec; scripting is taken as disabled
+    struct text_element
+    {
+        std::string_view name;
+        States state;
+        atom_id atom { atom_of(name) };
+    };
+
+    constexpr std::array<text_element, 9> text_elements { {
+        { "script", States::ScriptData },
+        { "style", States::RAWTEXT },
+        { "title", States::RCDATA },
+        { "textarea", States::RCDATA },
+        { "xmp", States::RAWTEXT },
+        { "iframe", States::RAWTEXT },
+        { "noembed", States::RAWTEXT },
+        { "noframes", States::RAWTEXT },
+        { "plaintext", States::PLAINTEXT },
+    } };
+
+    static_assert(std::ranges::none_of(text_elements, [](const text_element &element) { return element.atom == no_atom; }));
+
+    // Offset of the first "<tag" or "</tag" that starts a line in [from, size), size if there is none.
+    // A tokenizer that starts there in the data state is likely to be in the same state as the one that reaches it
+    auto find_segment_start(const input_buffer &data, std::size_t from) noexcept -> std::size_t
+    {
+        const auto *first = data.data() + from;
+        const auto *last  = data.data() + data.size();
+
+        while ((first = scanner::find_line_break(first, last)) != last)
+        {
+            const auto *tag = std::next(first);
+            if (last - tag >= 3 && *tag == '<' && (scanner::has_class(tag[1], scanner::class_alpha) || (tag[1] == '/' && scanner::has_class(tag[2], scanner::class_alpha))))
+                return static_cast<std::size_t>(tag - data.data());
+            first = tag;
+        }
+
+        return data.size();
+    }
+
+    // Estimates how many tokens and errors a document gives from its size and from the number of '<' in samples of it, so that
+    // small documents do not reserve much and large ones do not grow their buffers over and over. The ratios start at values
+    // usual for HTML and follow the documents tokenized before with an exponential moving average
+    struct capacity_model
+    {
+        static constexpr std::size_t sample_size = 4096; // bytes of each of the samples, at the start, the middle and the end
+        static constexpr std::size_t max_pooled  = std::size_t { 16 } << 10; // bytes; the pool backs a reservation with 1000 chunks its size, 16 MiB
+        static constexpr std::size_t min_tokens  = 16;
+        static constexpr std::size_t max_tokens  = std::size_t { 1 } << 16; // not pooled; it only bounds what a wrong estimate reserves
+        static constexpr std::size_t min_errors  = 16;
+        static constexpr std::size_t max_errors  = max_pooled / sizeof(error_record);
+        static constexpr double weight           = 0.25; // of the last document in the averages
+
+        // Estimated number of '<' in input
+        [[nodiscard]] static auto count_tags(std::string_view input) noexcept -> std::size_t
+        {
+            const auto count = [&](std::size_t offset, std::size_t size) {
+                const auto *first = input.data() + offset;
+                return static_cast<std::size_t>(std::count(first, first + size, '<'));
+            };
+
+            if (input.size() <= 3 * sample_size)
+                return count(0, input.size());
+
+            const auto sampled = count(0, sample_size) + count((input.size() - sample_size) / 2, sample_size) + count(input.size() - sample_size, sample_size);
+            return sampled * input.size() / (3 * sample_size);
+        }
+
+        [[nodiscard]] auto tokens(std::size_t tags) const noexcept -> std::size_t
+        {
+            return std::clamp(static_cast<std::size_t>(static_cast<double>(tags) * tokens_per_tag), min_tokens, max_tokens);
+        }
+
+        [[nodiscard]] auto errors(std::size_t bytes) const noexcept -> std::size_t
+        {
+            return std::clamp(static_cast<std::size_t>(static_cast<double>(bytes) * errors_per_byte), min_errors, max_errors);
+        }
+
+        // Refines the ratios with the counts of a document that was tokenized to the end
+        auto observe(std::size_t bytes, std::size_t tags, std::size_t token_count, std::size_t error_count) noexcept -> void
+        {
+            if (tags != 0)
+                tokens_per_tag += weight * (static_cast<double>(token_count) / static_cast<double>(tags) - tokens_per_tag);
+            errors_per_byte += weight * (static_cast<double>(error_count) / static_cast<double>(bytes) - errors_per_byte);
+        }
+
+        double tokens_per_tag { 2.0 };            // a tag and the text after it
+        double errors_per_byte { 1.0 / 4096.0 };
+    };
+
+    // Attributes of the emitted tag tokens. The attributes of a tag are moved here in one piece, in blocks that are never
+    // reallocated, so the spans of the tokens stay valid while more tags are stored. The tokenizer clears the store once no
+    // token refers to it any more, and the blocks are reused
+    class attribute_store
+    {
+    public:
+        static constexpr std::size_t block_size = 256;
+
+        // Moves the elements of attributes into the store
+        auto store(std::span<attribute> attributes) -> attribute_span
+        {
+            if (attributes.empty())
+                return {};
+
+            while (_current < _blocks.size() && _blocks[_current].capacity() - _blocks[_current].size() < attributes.size())
+                ++_current;
+
+            if (_current == _blocks.size())
+                _blocks.emplace_back().reserve(std::max(block_size, attributes.size()));
+
+            auto &block       = _blocks[_current];
+            const auto offset = block.size();
+            std::move(attributes.begin(), attributes.end(), std::back_inserter(block));
+            return { block.data() + offset, attributes.size() };
+        }
+
+        auto clear() noexcept -> void
+        {
+            for (auto &block : _blocks)
+                block.clear();
+            _current = 0;
+        }
+
+        // Releases every block but the first one if the store holds more than max_capacity attributes. 0 keeps every block
+        auto trim(std::size_t max_capacity) -> void
+        {
+            if (max_capacity == 0 || _blocks.size() * block_size <= max_capacity)
+                return;
+            _blocks.resize(1);
+        }
+
+    private:
+        sc_vector<sc_vector<attribute>> _blocks;
+        std::size_t _current { 0 }; // first block that may have room
+    };
+
+    // Return states of the character reference states. A reference is never nested in another one, so the stack holds at most
+    // the state that consumed the ampersand; the storage is inline and a push or a pop is a store and a decrement
+    class return_state_stack
+    {
+    public:
+        static constexpr std::size_t capacity = 4;
+
+        auto push(States state) noexcept -> void
+        {
+            assert(_size < capacity);
+            // Should the grammar ever nest deeper, the innermost return state is the one that matters
+            _states[std::min(_size, capacity - 1)] = state;
+            _size                                  = std::min(_size + 1, capacity);
+        }
+
+        auto pop() noexcept -> void
+        {
+            assert(_size != 0);
+            --_size;
+        }
+
+        [[nodiscard]] auto top() const noexcept -> States
+        {
+            assert(_size != 0);
+            return _states[_size - 1];
+        }
+
+        [[nodiscard]] auto empty() const noexcept -> bool
+        {
+            return _size == 0;
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t
+        {
+            return _size;
+        }
+
+        auto clear() noexcept -> void
+        {
+            _size = 0;
+        }
+
+    private:
+        std::array<States, capacity> _states {};
+        std::size_t _size { 0 };
+    };
+
+    // Characters held back by feed() so that the states that look ahead never reach the end of a partial input.
+    // The longest lookahead is the one of the named character reference state: the longest reference and the character after it
+    constexpr std::size_t stream_lookahead = encoding::max_reference_size + 1;
+
     struct Tokenizer::Impl
     {
         explicit Impl(scrp::sc_string src) :
-            data { std::move(src) }
+            data { std::move(src) },
+            current_token_data { data },
+            extra_token_data_0 { data },
+            extra_token_data_1 { data }
+        {
+            reserve_buffers();
+        }
+
+        explicit Impl(mapped_file file) :
+            Impl(sc_string {})
         {
-            tokens.reserve(5000);
-            errors.reserve(5000);
-            attributes.reserve(20);
+            mapping = std::move(file);
+            data.assign_external(mapping.view());
+        }
+
+        auto reserve_buffers() -> void
+        {
+            // Unless the tokens are kept, the buffer never holds more than a pending character token and the token being emitted.
+            // Both grow from here with the estimate of plan_capacity()
+            tokens.reserve(capacity_model::min_tokens);
+            errors.reserve(capacity_model::min_errors);
 
             current_token_data.reserve(64);
-            named_reference.reserve(64);
             extra_token_data_0.reserve(64);
             extra_token_data_1.reserve(64);
             ambiguous_character_reference.reserve(64);
         }
 
+        // Releases the storage of a buffer that grew beyond max_capacity elements. 0 keeps every buffer
+        template <typename Container>
+        static auto trim(Container &container, std::size_t max_capacity) -> void
+        {
+            if (max_capacity != 0 && container.capacity() > max_capacity)
+                Container {}.swap(container);
+        }
+
+        // Reserves for the tokens and errors expected of the input, once it is complete and before anything of it was consumed.
+        // The input given with feed() is only planned when finish() gets it whole
+        auto plan_capacity(bool kept_tokens) -> void
+        {
+            if (planned_bytes != 0 || next_offset != 0 || base_offset != 0 || data.empty())
+                return;
+
+            planned_bytes = data.size();
+            planned_tags  = capacity_model::count_tags({ data.data(), data.size() });
+
+            // try_tokenize() already made room for its budget, and more would never be used
+            const auto limit = budget != 0 ? budget : std::numeric_limits<std::size_t>::max();
+            errors.reserve(std::min({ capacity.errors(planned_bytes), limit, kept_errors_limit() }));
+            if (kept_tokens)
+                tokens.reserve(std::min(capacity.tokens(planned_tags), limit));
+        }
+
+        // Everything but the parser and the flags goes back to the state of a new tokenizer; the buffers are only cleared
+        auto reset(sc_string src, std::size_t max_capacity) -> void
+        {
+            // A document that was not stopped refines the estimates of the next ones
+            if (planned_bytes != 0 && finished && !stopped)
+                capacity.observe(planned_bytes, planned_tags, delivered_tokens, errors.size());
+
+            state.clear();
+            errors.clear();
+            error_total = 0;
+            tokens.clear();
+            segment_tokens.clear();
+            attributes.clear();
+            stored_attributes.clear();
+            line_breaks.clear();
+            current_token_data.clear();
+            extra_token_data_0.clear();
+            extra_token_data_1.clear();
+            ambiguous_character_reference.clear();
+
+            trim(errors, max_capacity);
+            trim(tokens, max_capacity);
+            trim(line_breaks, max_capacity);
+            trim(current_token_data.text, max_capacity);
+            trim(extra_token_data_0.text, max_capacity);
+            trim(extra_token_data_1.text, max_capacity);
+            trim(ambiguous_character_reference, max_capacity);
+            if (max_capacity != 0 && attributes.capacity() > max_capacity)
+                attributes = attribute_list {};
+            stored_attributes.trim(max_capacity);
+
+            // An empty source is the start of a streamed input; keep the storage for feed()
+            if (src.empty())
+            {
+                trim(data.storage, max_capacity);
+                data.clear();
+            }
+            else
+                data.assign(std::move(src));
+
+            mapping = {};
+
+            reserve_buffers();
+
+            next_token        = 0;
+            delivered_tokens  = 0;
+            planned_bytes     = 0;
+            planned_tags      = 0;
+            cursor            = {};
+            base_offset       = 0;
+            next_offset       = 0;
+            run_limit         = 0;
+            indexed_offset    = 0;
+            current_state     = States::Data;
+            content_state     = States::Data;
+            content_tag       = {};
+            numeric_reference = 0;
+            end_tag           = false;
+            skip_tag          = false;
+            end_of_input      = true;
+            finished          = false;
+            stopped           = false;
+            over_budget       = false;
+            suspend_on_token  = false;
+            quirk_flag        = true;
+        }
+
+        // Prepares a tokenizer of tokenize_parallel() to start at offset of input, in the data state
+        auto start_segment(std::string_view input, std::size_t offset) -> void
+        {
+            reset({}, 0);
+            data.assign_external(input);
+            next_offset = offset;
+        }
+
+        // Whether a tag named name is given when a tag interest set is in use
+        [[nodiscard]] auto wants_tag(std::string_view name) const -> bool
+        {
+            if (const auto atom = atom_of(name); atom != no_atom)
+                return interest_atoms.test(atom);
+            return std::find(interest_names.begin(), interest_names.end(), name) != interest_names.end();
+        }
+
+        // Called once the name of the current tag is complete
+        auto select_tag() -> void
+        {
+            skip_tag = tag_filter && !wants_tag(current_token_data.view());
+        }
+
+        // true if the tokenizer stopped right at offset, in the data state and with nothing in progress: the state
+        // of a new tokenizer that starts at offset
+        [[nodiscard]] auto at_data_boundary(std::size_t offset) const noexcept -> bool
+        {
+            return next_offset == offset && current_state == States::Data && content_state == States::Data && state.empty() && !end_tag;
+        }
+
+        // true if buffer can take one more element without going over the budget of try_tokenize(). Otherwise the tokenizer stops
+        template <typename Container>
+        [[nodiscard]] auto within_budget(const Container &buffer) noexcept -> bool
+        {
+            if (budget == 0 || buffer.size() < budget)
+                return true;
+
+            over_budget = true;
+            stopped     = true;
+            finished    = true;
+            return false;
+        }
+
+        // Releases every token; their attributes go with them
+        auto drop_tokens() noexcept -> void
+        {
+            tokens.clear();
+            stored_attributes.clear();
+        }
+
+        // Every token emitted starts the next one with empty buffers
+        auto clear_token_data() noexcept -> void
+        {
+            current_token_data.clear();
+            extra_token_data_0.clear();
+            extra_token_data_1.clear();
+            attributes.clear();
+        }
+
+        // Appends text to the character token that waits to be consumed and returns true, or returns false if there is none.
+        // span is where text is in the source, empty if it is not there; a span that follows the one of the token extends it.
+        // A run of text is built in the pending token instead of a token per piece that is merged and released
+        auto append_characters(source_span span, std::string_view text) -> bool
+        {
+            if (tokens.empty() || tokens.back()->consumed)
+                return false;
+
+            clear_token_data();
+
+            auto *last = tokens.back().as<CharacterToken>();
+            if (!last->span.empty() && !span.empty() && last->span.offset + last->span.length == span.offset)
+            {
+                last->span.length += span.length;
+                return true;
+            }
+
+            if (!last->span.empty())
+            {
+                last->code_point.assign(data.data() + last->span.offset, last->span.length);
+                last->span = {};
+            }
+
+            last->code_point.append(text.data(), text.size());
+            return true;
+        }
+
+        // Number of errors the error policy keeps
+        [[nodiscard]] auto kept_errors_limit() const noexcept -> std::size_t
+        {
+            switch (error_mode)
+            {
+                case error_policy::all:
+                    return std::numeric_limits<std::size_t>::max();
+                case error_policy::first:
+                    return error_limit;
+                default:
+                    return 0;
+            }
+        }
+
+        auto keep_error(const error_record &error) -> void
+        {
+            if (errors.size() < kept_errors_limit() && within_budget(errors))
+                errors.push_back(error);
+        }
+
+        // Without a parser, consumed tokens wait in tokens until next() gives them
+        [[nodiscard]] auto has_ready_token() const noexcept -> bool
+        {
+            return next_token < tokens.size() && tokens[next_token]->consumed;
+        }
+
+        // Offset in the input of the character being consumed
+        [[nodiscard]] auto cursor_offset() const noexcept -> std::size_t
+        {
+            return base_offset + static_cast<std::size_t>(cursor - data.begin());
+        }
+
+        // Adds the line breaks before offset to line_breaks. A CR/LF pair is one line break, at the LF
+        auto index_lines(std::size_t offset) -> void
+        {
+            if (offset <= indexed_offset)
+                return;
+
+            const auto *end   = data.data() + data.size();
+            const auto *first = data.data() + (indexed_offset - base_offset);
+            const auto *last  = data.data() + std::min(offset - base_offset, data.size());
+
+            while ((first = scanner::find_line_break(first, last)) != last)
+            {
+                if (*first == '\n' || std::next(first) == end || *std::next(first) != '\n')
+                    line_breaks.push_back(base_offset + static_cast<std::size_t>(first - data.data()));
+                ++first;
+            }
+
+            indexed_offset = offset;
+        }
+
+        // Number of line breaks before offset
+        [[nodiscard]] auto line_breaks_before(std::size_t offset) -> std::size_t
+        {
+            index_lines(offset);
+            return static_cast<std::size_t>(std::lower_bound(line_breaks.begin(), line_breaks.end(), offset) - line_breaks.begin());
+        }
+
+        [[nodiscard]] auto line_of(std::size_t offset) -> std::size_t
+        {
+            return line_breaks_before(offset) + 1;
+        }
+
+        [[nodiscard]] auto column_of(std::size_t offset) -> std::size_t
+        {
+            const auto breaks = line_breaks_before(offset);
+            return breaks == 0 ? offset : offset - line_breaks[breaks - 1] - 1;
+        }
+
     public:
-        sc_stack<States> state;
-        sc_vector<parser_error> errors;
-        sc_vector<Token *> tokens;
-        sc_unordered_map<sc_string, sc_string> attributes;
-        sc_string data;
-        sc_string current_token_data;
-        sc_string named_reference;
-        sc_string extra_token_data_0;
-        sc_string extra_token_data_1;
+        return_state_stack state;
+        sc_vector<error_record> errors;
+        std::size_t error_total { 0 }; // errors counted, the ones not kept included
+        error_policy error_mode { error_policy::all };
+        std::size_t error_limit { 0 }; // of error_policy::first
+        token_vector tokens;
+        std::size_t next_token { 0 }; // index in tokens of the next token given by next()
+        std::size_t delivered_tokens { 0 };
+        capacity_model capacity;
+        std::size_t planned_bytes { 0 }; // size of the input planned by plan_capacity(), 0 if it was not
+        std::size_t planned_tags { 0 };  // estimated number of '<' in it
+        // Consumed tokens of a segment of tokenize_parallel(); the capacity is kept from one segment to the next
+        token_vector segment_tokens;
+        bool buffer_segment { false };
+        attribute_list attributes;       // of the tag being built
+        attribute_store stored_attributes; // of the emitted tags
+        input_buffer data;
+        mapped_file mapping; // keeps the memory of data alive when the input is a mapped file
+        token_buffer current_token_data;
+        token_buffer extra_token_data_0;
+        token_buffer extra_token_data_1;
         sc_string ambiguous_character_reference;
-        encoding::character_reference last_char_reference;
-        std::size_t current_position { 0 };
-        std::size_t current_line { 1 };
-        std::size_t line_offset { 0 };
+        input_iterator cursor;       // the character being consumed while run() is in progress
+        std::size_t base_offset { 0 };    // offset in the input of the first character in data
+        std::size_t next_offset { 0 };    // offset in data of the next character to consume
+        std::size_t run_limit { 0 };      // offset in data where the current run() stops
+        std::vector<std::size_t> line_breaks; // offsets in the input of the line breaks, built on demand; as large as the input, not pooled
+        std::size_t indexed_offset { 0 };     // line_breaks holds every line break before this offset
+        States current_state { States::Data };
+        States content_state { States::Data }; // the data state switches to it; set by the start tags in text_elements
+        std::string_view content_tag;          // name of the element whose contents are being tokenized
         parser *parser { nullptr };
         uint32_t numeric_reference { 0 };
         bool keep_tokens { false };
+        bool use_spans { false };
         bool end_tag { false };
+        bool tag_filter { false };                         // set_tag_interest() was given names
+        bool skip_tag { false };                           // the current tag is not in the interest set
+        std::bitset<atoms::names.size()> interest_atoms;   // tag names of the interest set that have an atom
+        sc_vector<sc_string> interest_names;               // the others
+        bool end_of_input { true }; // false from the first feed() until finish()
+        bool finished { false };
+        bool stopped { false }; // set by stop(); finished is set as well
+        std::size_t budget { 0 }; // of try_tokenize() for the kept tokens and the errors, 0 while it is not running
+        bool over_budget { false };
+        bool suspend_on_token { false };
         bool quirk_flag { true }; // only used in the bogus_doctype function and is set to false
                                   // when After DOCTYPE system identifier state triggers the Bogus DOCTYPE state
     };
 } // namespace scrp
 
+scrp::Tokenizer::Tokenizer() :
+    Tokenizer(sc_string {})
+{
+}
+
 scrp::Tokenizer::Tokenizer(scrp::sc_string source) :
     _impl { new Impl(std::move(source)) }
 {
     assert(scrp::is_initialized());
 }
 
-scrp::Tokenizer::~Tokenizer()
+scrp::Tokenizer::Tokenizer(mapped_file input) :
+    _impl { new Impl(std::move(input)) }
+{
+    assert(scrp::is_initialized());
+}
+
+scrp::Tokenizer::~Tokenizer() = default;
+
+auto scrp::Tokenizer::reset(sc_string source, std::size_t max_capacity) -> void
+{
+    _impl->reset(std::move(source), max_capacity);
+}
+
+auto scrp::Tokenizer::reset(mapped_file input, std::size_t max_capacity) -> void
+{
+    _impl->reset({}, max_capacity);
+    _impl->mapping = std::move(input);
+    _impl->data.assign_external(_impl->mapping.view());
+}
+
+auto scrp::Tokenizer::reset_view(std::string_view source, std::size_t max_capacity) -> void
+{
+    _impl->reset({}, max_capacity);
+    _impl->data.assign_external(source);
+}
+
+auto scrp::Tokenizer::set_parser(parser *parser) -> void
 {
-    for (auto &_tok : _impl->tokens)
+    _impl->parser = parser;
+}
+
+auto scrp::Tokenizer::tokenize() -> bool
+{
+    return finish();
+}
+
+auto scrp::Tokenizer::try_tokenize(std::size_t budget) noexcept -> tokenize_status
+{
+    if (_impl->data.empty())
+        return tokenize_status::empty;
+
+    auto status = tokenize_status::done;
+
+    try
     {
-        release_token(_tok);
+        if (budget != 0)
+        {
+            // Room for budget elements is made before the first character, up to the largest reservations of the capacity model;
+            // the buffers only grow in the loop past them, and a failure there is out_of_memory as well
+            _impl->errors.reserve(std::min(budget, capacity_model::max_errors));
+            if (_impl->parser == nullptr || _impl->keep_tokens)
+                _impl->tokens.reserve(std::min(budget, capacity_model::max_tokens));
+            _impl->budget = budget;
+        }
+
+        (void)finish();
+
+        if (_impl->over_budget)
+            status = tokenize_status::over_budget;
+        else if (_impl->stopped)
+            status = tokenize_status::stopped;
+    } catch (const std::bad_alloc &)
+    {
+        // Also when the pool cannot allocate a block
+        status = tokenize_status::out_of_memory;
+    } catch (...)
+    {
+        status = tokenize_status::failed;
     }
+
+    _impl->budget = 0;
+
+    // An exception leaves the state machine in the middle of a state; nothing can go on from there
+    if (status == tokenize_status::out_of_memory || status == tokenize_status::failed)
+        stop();
+
+    return status;
 }
 
-auto scrp::Tokenizer::release_token(Token *&tok) -> void
+auto scrp::Tokenizer::tokenize_parallel(std::size_t threads, std::size_t segment_size) -> bool
 {
-    switch (tok->type)
-    {
+    const auto size = _impl->data.size();
 
-        case TokenType::Comment:
-            {
-                auto *t = dynamic_cast<CommentToken *>(tok);
-                get_token_pool<CommentToken>()->release(t);
-            }
-            break;
-        case TokenType::EndOfFile:
-            {
-                auto *t = dynamic_cast<EOFToken *>(tok);
-                get_token_pool<EOFToken>()->release(t);
-            }
-            break;
-        case TokenType::DOCTYPE:
-            {
-                auto *t = dynamic_cast<DOCTYPEToken *>(tok);
-                get_token_pool<DOCTYPEToken>()->release(t);
-            }
+    if (_impl->stopped)
+        return true;
+
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    segment_size = std::max<std::size_t>(segment_size, 1);
+
+    // Segment i is [starts[i], starts[i + 1])
+    sc_vector<std::size_t> starts { 0 };
+    while (size - starts.back() > segment_size)
+    {
+        const auto start = find_segment_start(_impl->data, starts.back() + segment_size);
+        if (start == size)
             break;
-        case TokenType::CDATA:
+        starts.push_back(start);
+    }
+    starts.push_back(size);
+
+    const auto segments = starts.size() - 1;
+    if (threads < 2 || segments < 2)
+        return tokenize();
+
+    _impl->plan_capacity(_impl->parser == nullptr || _impl->keep_tokens);
+
+    // One tokenizer per thread, and one more for the tokenizer that waits for the check of the next wave. They are
+    // reused from wave to wave, so their buffers are allocated once
+    std::vector<std::unique_ptr<Tokenizer>> workers;
+    workers.reserve(threads + 1);
+    for (std::size_t i = 0; i <= threads; ++i)
+    {
+        auto &worker = workers.emplace_back(std::make_unique<Tokenizer>());
+        if (_impl->use_spans)
+            worker->use_source_spans();
+        worker->_impl->tag_filter     = _impl->tag_filter;
+        worker->_impl->interest_atoms = _impl->interest_atoms;
+        worker->_impl->interest_names = _impl->interest_names;
+        worker->_impl->error_mode     = _impl->error_mode;
+        worker->_impl->error_limit    = _impl->error_limit;
+        worker->_impl->buffer_segment = true;
+    }
+
+    // Give the tokens and errors of a tokenizer to the parser. Every segment in the chain but the first starts with a tag,
+    // so no character tokens need to be merged across segments, and the last character token of a segment is complete
+    const bool keep = _impl->parser == nullptr || _impl->keep_tokens;
+    const auto take = [this, keep](Tokenizer &worker) {
+        if (_impl->stopped)
+            return;
+
+        auto &impl = *worker._impl;
+        for (const auto &error : impl.errors)
+            _impl->keep_error(error);
+        _impl->error_total += impl.error_total;
+        impl.errors.clear();
+        impl.error_total = 0;
+
+        // The attributes of the kept tokens are moved to the store of this tokenizer, as the worker reuses its own
+        const auto take_tokens = [this, keep](auto &tokens) {
+            for (auto it = tokens.begin(); it != tokens.end() && !_impl->stopped; ++it)
             {
-                auto *t = dynamic_cast<CDATAToken *>(tok);
-                get_token_pool<CDATAToken>()->release(t);
+                if (!keep)
+                {
+                    deliver_token(*it);
+                    continue;
+                }
+
+                auto &token = _impl->tokens.emplace_back(std::move(*it));
+                if (auto *tag = token.template as<TagToken>(); tag != nullptr)
+                    tag->attributes = _impl->stored_attributes.store(tag->attributes);
+                deliver_token(token);
             }
-            break;
-        case TokenType::Character:
+            tokens.clear();
+        };
+        take_tokens(impl.segment_tokens);
+        take_tokens(impl.tokens);
+        impl.stored_attributes.clear();
+    };
+
+    // The tokenizer of the input up to the current wave, stopped where its segments end
+    Tokenizer *tail = nullptr;
+
+    for (std::size_t first = 0; first < segments && !_impl->stopped; first += threads)
+    {
+        const auto count = std::min(threads, segments - first);
+
+        sc_vector<Tokenizer *> wave;
+        for (const auto &worker : workers)
+        {
+            if (worker.get() == tail || wave.size() == count)
+                continue;
+            worker->_impl->start_segment(_impl->data, starts[first + wave.size()]);
+            wave.push_back(worker.get());
+        }
+
+        // Every segment but the first of the input is tokenized as if the data state started at its first character.
+        // A worker that fails is as good as a wrong guess: its segment is tokenized again below
+        std::vector<std::exception_ptr> failures(count);
+        {
+            const auto run_segment = [&](std::size_t i) {
+                try
+                {
+                    wave[i]->run(starts[first + i + 1]);
+                } catch (...)
+                {
+                    failures[i] = std::current_exception();
+                }
+            };
+
+            std::vector<std::jthread> pool;
+            pool.reserve(count - 1);
+            for (std::size_t i = 1; i < count; ++i)
+                pool.emplace_back(run_segment, i);
+            run_segment(0);
+        }
+
+        // The result of a segment is kept only if the tokenizer of the input before it stopped in the state that was guessed.
+        // Otherwise that tokenizer goes on through the segment, and its state is checked at the start of the next one
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto segment = first + i;
+
+            if (tail == nullptr)
             {
-                auto *t = dynamic_cast<CharacterToken *>(tok);
-                get_token_pool<CharacterToken>()->release(t);
+                if (failures[i])
+                    std::rethrow_exception(failures[i]);
+                tail = wave[i];
             }
-            break;
-        case TokenType::EndTag:
-            [[fallthrough]];
-        case TokenType::Tag:
+            else if (!failures[i] && tail->_impl->at_data_boundary(starts[segment]))
             {
-                auto *t = dynamic_cast<TagToken *>(tok);
-                get_token_pool<TagToken>()->release(t);
+                take(*tail);
+                tail = wave[i];
             }
-            break;
+            else
+                tail->run(starts[segment + 1]);
+        }
+    }
+
+    if (!_impl->stopped)
+    {
+        tail->end_of_file();
+        take(*tail);
     }
+
+    _impl->next_offset = size;
+    _impl->finished    = true;
+
+    return true;
 }
 
-auto scrp::Tokenizer::set_parser(parser *parser) -> void
+auto scrp::Tokenizer::feed(std::string_view chunk) -> void
 {
-    _impl->parser = parser;
+    if (_impl->stopped)
+        return;
+
+    _impl->end_of_input = false;
+
+    if (!_impl->use_spans && _impl->next_offset > 1)
+    {
+        // Nothing refers to the consumed input; keep only the last consumed character for the reconsume cases.
+        // Line numbers of later positions still depend on it, so its line breaks are indexed before it goes
+        const auto consumed = _impl->next_offset - 1;
+        _impl->index_lines(_impl->base_offset + consumed);
+        _impl->data.erase_front(consumed);
+        _impl->base_offset += consumed;
+        _impl->next_offset -= consumed;
+    }
+
+    _impl->data.append(chunk);
+
+    // Hold back enough characters for the states that look ahead, they are consumed by the next feed() or by finish()
+    if (_impl->data.size() > stream_lookahead)
+        run(_impl->data.size() - stream_lookahead);
 }
 
-auto scrp::Tokenizer::tokenize() -> bool
+auto scrp::Tokenizer::finish() -> bool
 {
+    if (_impl->stopped)
+        return true;
+
+    _impl->end_of_input = true;
+
     if (_impl->data.empty())
         return false;
 
-    States currentState = States::Data; // Initial state
-    sc_string tokenName;
-    tokenName.reserve(32);
+    _impl->plan_capacity(_impl->parser == nullptr || _impl->keep_tokens);
+
+    run(_impl->data.size());
+
+    end_of_file();
+
+    return true;
+}
+
+auto scrp::Tokenizer::next() -> Token *
+{
+    if (_impl->stopped)
+        return nullptr;
+
+    if (!_impl->keep_tokens && _impl->next_token != 0)
+    {
+        // Release the tokens already given
+        _impl->tokens.erase(_impl->tokens.begin(), std::next(_impl->tokens.begin(), static_cast<std::ptrdiff_t>(_impl->next_token)));
+        _impl->next_token = 0;
+        if (_impl->tokens.empty())
+            _impl->stored_attributes.clear();
+    }
 
-    bool new_line_state = false;
-    for (auto dataIterator = _impl->data.begin(); dataIterator != _impl->data.end(); ++dataIterator)
+    while (!_impl->has_ready_token())
     {
-        if (*dataIterator == '\r')
-        {
-            ++_impl->current_position;
-            ++_impl->line_offset;
-            new_line_state = true;
-            continue;
-        }
+        if (_impl->finished)
+            return nullptr;
 
-        if (*dataIterator == '\n')
+        if (_impl->next_offset < _impl->data.size())
         {
-            // if new_line_state == true this is the CR/LF case
-            // if new_line_state == false this is the LF case
-            // in either case the parser will ignore the flag
-            _impl->line_offset = 0;
-            ++_impl->current_position;
-            ++_impl->current_line;
-            new_line_state = false;
-            continue;
-        }
+            _impl->plan_capacity(_impl->keep_tokens);
 
-        if (new_line_state && *dataIterator != '\n')
-        {
-            // This is the old CR new line case; current_position must not be updated
-            _impl->line_offset = 0;
-            ++_impl->current_line;
-            new_line_state = false;
+            // Run the state machine only until it gives a token
+            _impl->end_of_input     = true;
+            _impl->suspend_on_token = true;
+            run(_impl->data.size());
+            _impl->suspend_on_token = false;
         }
+        else
+            end_of_file();
+    }
 
-        try
-        {
-            switch (currentState)
-            {
-                case States::Data:
-                    data_state(dataIterator, currentState);
-                    break;
-                case States::CharacterReference:
-                    character_reference(dataIterator, currentState);
-                    break;
-                case States::NamedCharacterReference:
-                    named_character_reference(dataIterator, currentState);
-                    break;
-                case States::NumericCharacterReference:
-                    numeric_character_reference(dataIterator, currentState);
-                    break;
-                case States::HexadecimalCharacterReferenceStart:
-                    hexadecimal_character_reference_start(dataIterator, currentState);
-                    break;
-                case States::DecimalCharacterReferenceStart:
-                    decimal_character_reference_start(dataIterator, currentState);
-                    break;
-                case States::HexadecimalCharacterReference:
-                    hexadecimal_character_reference(dataIterator, currentState);
-                    break;
-                case States::DecimalCharacterReference:
-                    decimal_character_reference(dataIterator, currentState);
-                    break;
-                case States::NumericCharacterReferenceEnd:
-                    numeric_character_reference_end(dataIterator, currentState);
-                    break;
-                case States::TagOpen:
-                    tag_open_state(dataIterator, currentState);
-                    break;
-                case States::AmbiguousAmpersand:
-                    ambiguous_ampersand(dataIterator, currentState);
-                    break;
-                case States::MarkupDeclarationOpen:
-                    markup_declaration_open(dataIterator, currentState);
-                    break;
-                case States::CommentStart:
-                    comment_start(dataIterator, currentState);
-                    break;
-                case States::BogusComment:
-                    bogus_comment(dataIterator, currentState);
-                    break;
-                case States::CommentStartDash:
-                    comment_start_dash(dataIterator, currentState);
-                    break;
-                case States::Comment:
-                    comment(dataIterator, currentState);
-                    break;
-                case States::CommentEnd:
-                    comment_end(dataIterator, currentState);
-                    break;
-                case States::CommentLessThanSign:
-                    comment_less_than_sign(dataIterator, currentState);
-                    break;
-                case States::CommentLessThanSignBang:
-                    comment_less_than_sign_bang(dataIterator, currentState);
-                    break;
-                case States::CommentLessThanSignBangDash:
-                    comment_less_than_sign_bang_dash(dataIterator, currentState);
-                    break;
-                case States::CommentLessThanSignBangDashDash:
-                    comment_less_than_sign_bang_dash_dash(dataIterator, currentState);
-                    break;
-                case States::CommentEndDash:
-                    comment_end_dash(dataIterator, currentState);
-                    break;
-                case States::CommentEndBang:
-                    comment_end_bang(dataIterator, currentState);
-                    break;
-                case States::DOCTYPE:
-                    doctype(dataIterator, currentState);
-                    break;
-                case States::BeforeDOCTYPEName:
-                    before_doctype_name(dataIterator, currentState);
-                    break;
-                case States::DOCTYPEName:
-                    doctype_name(dataIterator, currentState);
-                    break;
-                case States::AfterDOCTYPEName:
-                    after_doctype_name(dataIterator, currentState);
-                    break;
-                case States::AfterDOCTYPEPublicKeyword:
-                    after_doctype_public_keyword(dataIterator, currentState);
-                    break;
-                case States::BeforeDOCTYPEPublicIdentifier:
-                    before_doctype_public_identifier(dataIterator, currentState);
-                    break;
-                case States::DOCTYPEPublicIdentifierDQ:
-                    doctype_public_identifier_dq(dataIterator, currentState);
-                    break;
-                case States::DOCTYPEPublicIdentifierSQ:
-                    doctype_public_identifier_sq(dataIterator, currentState);
-                    break;
-                case States::AfterDOCTYPEPublicIdentifier:
-                    after_doctype_public_identifier(dataIterator, currentState);
-                    break;
-                case States::BetweenDOCTYPEPublicAndSystemIdentifiers:
-                    between_doctype_public_and_system_identifiers(dataIterator, currentState);
-                    break;
-                case States::AfterDOCTYPESystemKeyword:
-                    after_doctype_system_keyword(dataIterator, currentState);
-                    break;
-                case States::BeforeDOCTYPESystemIdentifier:
-                    before_doctype_system_identifier(dataIterator, currentState);
-                    break;
-                case States::DOCTYPESystemIdentifierDQ:
-                    doctype_system_identifier_dq(dataIterator, currentState);
-                    break;
-                case States::DOCTYPESystemIdentifierSQ:
-                    doctype_system_identifier_sq(dataIterator, currentState);
-                    break;
-                case States::AfterDOCTYPESystemIdentifier:
-                    after_doctype_system_identifier(dataIterator, currentState);
-                    break;
-                case States::BogusDOCTYPE:
-                    bogus_doctype(dataIterator, currentState);
-                    break;
-                case States::CDATASection:
-                    cdata_section(dataIterator, currentState);
-                    break;
-                case States::CDATASectionBracket:
-                    cdata_section_bracket(dataIterator, currentState);
-                    break;
-                case States::CDATASectionEnd:
-                    cdata_section_end(dataIterator, currentState);
-                    break;
-                case States::EndTagOpen:
-                    end_tag_open(dataIterator, currentState);
-                    break;
-                case States::TagName:
-                    tag_name(dataIterator, currentState);
-                    break;
-                case States::BeforeAttributeName:
-                    before_attribute_name(dataIterator, currentState);
-                    break;
-                case States::SelfClosingStartTag:
-                    self_closing_start_tag(dataIterator, currentState);
-                    break;
-                case States::AttributeName:
-                    attribute_name(dataIterator, currentState);
-                    break;
-                case States::AfterAttributeName:
-                    after_attribute_name(dataIterator, currentState);
-                    break;
-                case States::BeforeAttributeValue:
-                    before_attribute_value(dataIterator, currentState);
-                    break;
-                case States::AttributeValueDQ:
-                    attribute_value_dq(dataIterator, currentState);
-                    break;
-                case States::AttributeValueSQ:
-                    attribute_value_sq(dataIterator, currentState);
-                    break;
-                case States::AttributeValueUnquoted:
-                    attribute_value_unquoted(dataIterator, currentState);
-                    break;
-                case States::AfterAttributeValueQuoted:
-                    after_attribute_value_quoted(dataIterator, currentState);
-                    break;
-            }
+    return _impl->tokens[_impl->next_token++];
+}
+
+auto scrp::Tokenizer::end_of_file() -> void
+{
+    if (_impl->finished)
+        return;
 
-            if (dataIterator == _impl->data.end())
+    _impl->finished = true;
+    _impl->cursor   = _impl->data.end();
+
+    handle_eof_error(_impl->current_state);
+
+    // Character tokens are held until a token of another type is emitted. Do not lose the trailing ones
+    if (!_impl->tokens.empty() && !_impl->tokens.back()->consumed)
+        deliver_token(_impl->tokens.back());
+
+    if (_impl->parser != nullptr && !_impl->keep_tokens)
+        _impl->drop_tokens();
+}
+
+auto scrp::Tokenizer::run(std::size_t limit) -> void
+{
+    auto &currentState = _impl->current_state;
+    auto &dataIterator = _impl->cursor;
+
+    _impl->run_limit = limit;
+
+    const auto last = std::next(_impl->data.begin(), static_cast<std::ptrdiff_t>(limit));
+    dataIterator    = std::next(_impl->data.begin(), static_cast<std::ptrdiff_t>(_impl->next_offset));
+
+    for (; dataIterator < last; ++dataIterator)
+    {
+        switch (currentState)
+        {
+            case States::Data:
+                data_state(dataIterator, currentState);
+                break;
+            case States::RCDATA:
+                rcdata_state(dataIterator, currentState);
+                break;
+            case States::RAWTEXT: [[fallthrough]];
+            case States::ScriptData: [[fallthrough]];
+            case States::PLAINTEXT:
+                rawtext_state(dataIterator, currentState);
+                break;
+            case States::CharacterReference:
+                character_reference(dataIterator, currentState);
+                break;
+            case States::NamedCharacterReference:
+                named_character_reference(dataIterator, currentState);
+                break;
+            case States::NumericCharacterReference:
+                numeric_character_reference(dataIterator, currentState);
                 break;
+            case States::HexadecimalCharacterReferenceStart:
+                hexadecimal_character_reference_start(dataIterator, currentState);
+                break;
+            case States::DecimalCharacterReferenceStart:
+                decimal_character_reference_start(dataIterator, currentState);
+                break;
+            case States::HexadecimalCharacterReference:
+                hexadecimal_character_reference(dataIterator, currentState);
+                break;
+            case States::DecimalCharacterReference:
+                decimal_character_reference(dataIterator, currentState);
+                break;
+            case States::NumericCharacterReferenceEnd:
+                numeric_character_reference_end(dataIterator, currentState);
+                break;
+            case States::TagOpen:
+                tag_open_state(dataIterator, currentState);
+                break;
+            case States::AmbiguousAmpersand:
+                ambiguous_ampersand(dataIterator, currentState);
+                break;
+            case States::MarkupDeclarationOpen:
+                markup_declaration_open(dataIterator, currentState);
+                break;
+            case States::CommentStart:
+                comment_start(dataIterator, currentState);
+                break;
+            case States::BogusComment:
+                bogus_comment(dataIterator, currentState);
+                break;
+            case States::CommentStartDash:
+                comment_start_dash(dataIterator, currentState);
+                break;
+            case States::Comment:
+                comment(dataIterator, currentState);
+                break;
+            case States::CommentEnd:
+                comment_end(dataIterator, currentState);
+                break;
+            case States::CommentLessThanSign:
+                comment_less_than_sign(dataIterator, currentState);
+                break;
+            case States::CommentLessThanSignBang:
+                comment_less_than_sign_bang(dataIterator, currentState);
+                break;
+            case States::CommentLessThanSignBangDash:
+                comment_less_than_sign_bang_dash(dataIterator, currentState);
+                break;
+            case States::CommentLessThanSignBangDashDash:
+                comment_less_than_sign_bang_dash_dash(dataIterator, currentState);
+                break;
+            case States::CommentEndDash:
+                comment_end_dash(dataIterator, currentState);
+                break;
+            case States::CommentEndBang:
+                comment_end_bang(dataIterator, currentState);
+                break;
+            case States::DOCTYPE:
+                doctype(dataIterator, currentState);
+                break;
+            case States::BeforeDOCTYPEName:
+                before_doctype_name(dataIterator, currentState);
+                break;
+            case States::DOCTYPEName:
+                doctype_name(dataIterator, currentState);
+                break;
+            case States::AfterDOCTYPEName:
+                after_doctype_name(dataIterator, currentState);
+                break;
+            case States::AfterDOCTYPEPublicKeyword:
+                after_doctype_public_keyword(dataIterator, currentState);
+                break;
+            case States::BeforeDOCTYPEPublicIdentifier:
+                before_doctype_public_identifier(dataIterator, currentState);
+                break;
+            case States::DOCTYPEPublicIdentifierDQ:
+                doctype_public_identifier_dq(dataIterator, currentState);
+                break;
+            case States::DOCTYPEPublicIdentifierSQ:
+                doctype_public_identifier_sq(dataIterator, currentState);
+                break;
+            case States::AfterDOCTYPEPublicIdentifier:
+                after_doctype_public_identifier(dataIterator, currentState);
+                break;
+            case States::BetweenDOCTYPEPublicAndSystemIdentifiers:
+                between_doctype_public_and_system_identifiers(dataIterator, currentState);
+                break;
+            case States::AfterDOCTYPESystemKeyword:
+                after_doctype_system_keyword(dataIterator, currentState);
+                break;
+            case States::BeforeDOCTYPESystemIdentifier:
+                before_doctype_system_identifier(dataIterator, currentState);
+                break;
+            case States::DOCTYPESystemIdentifierDQ:
+                doctype_system_identifier_dq(dataIterator, currentState);
+                break;
+            case States::DOCTYPESystemIdentifierSQ:
+                doctype_system_identifier_sq(dataIterator, currentState);
+                break;
+            case States::AfterDOCTYPESystemIdentifier:
+                after_doctype_system_identifier(dataIterator, currentState);
+                break;
+            case States::BogusDOCTYPE:
+                bogus_doctype(dataIterator, currentState);
+                break;
+            case States::CDATASection:
+                cdata_section(dataIterator, currentState);
+                break;
+            case States::CDATASectionBracket:
+                cdata_section_bracket(dataIterator, currentState);
+                break;
+            case States::CDATASectionEnd:
+                cdata_section_end(dataIterator, currentState);
+                break;
+            case States::EndTagOpen:
+                end_tag_open(dataIterator, currentState);
+                break;
+            case States::TagName:
+                tag_name(dataIterator, currentState);
+                break;
+            case States::BeforeAttributeName:
+                before_attribute_name(dataIterator, currentState);
+                break;
+            case States::SelfClosingStartTag:
+                self_closing_start_tag(dataIterator, currentState);
+                break;
+            case States::AttributeName:
+                attribute_name(dataIterator, currentState);
+                break;
+            case States::AfterAttributeName:
+                after_attribute_name(dataIterator, currentState);
+                break;
+            case States::BeforeAttributeValue:
+                before_attribute_value(dataIterator, currentState);
+                break;
+            case States::AttributeValueDQ:
+                attribute_value_dq(dataIterator, currentState);
+                break;
+            case States::AttributeValueSQ:
+                attribute_value_sq(dataIterator, currentState);
+                break;
+            case States::AttributeValueUnquoted:
+                attribute_value_unquoted(dataIterator, currentState);
+                break;
+            case States::AfterAttributeValueQuoted:
+                after_attribute_value_quoted(dataIterator, currentState);
+                break;
+        }
 
-            ++_impl->line_offset;
-            ++_impl->current_position;
+        if (dataIterator == _impl->data.end() || _impl->stopped)
+            break;
 
-        } catch (...)
+        if (_impl->suspend_on_token && _impl->has_ready_token())
         {
-            throw;
+            ++dataIterator;
+            break;
         }
     }
 
-    handle_eof_error(currentState);
-
-    return true;
+    _impl->next_offset = static_cast<std::size_t>(std::distance(_impl->data.begin(), dataIterator));
 }
 
 auto scrp::Tokenizer::is_return_state_attribute() -> bool
@@ -424,83 +1370,128 @@ auto scrp::Tokenizer::keep_tokens() -> void
     _impl->keep_tokens = true;
 }
 
-auto scrp::Tokenizer::tokens() const -> const scrp::sc_vector<scrp::Token *> &
+auto scrp::Tokenizer::tokens() const -> const scrp::token_vector &
 {
     return _impl->tokens;
 }
 
-auto scrp::Tokenizer::insert_attribute(const sc_string &name, const sc_string &value) -> void
+auto scrp::Tokenizer::use_source_spans() -> void
+{
+    _impl->use_spans                     = true;
+    _impl->current_token_data.use_spans = true;
+    _impl->extra_token_data_0.use_spans = true;
+    _impl->extra_token_data_1.use_spans = true;
+}
+
+auto scrp::Tokenizer::use_owned_strings() -> void
+{
+    _impl->use_spans                     = false;
+    _impl->current_token_data.use_spans = false;
+    _impl->extra_token_data_0.use_spans = false;
+    _impl->extra_token_data_1.use_spans = false;
+}
+
+auto scrp::Tokenizer::set_tag_interest(std::span<const std::string_view> names) -> void
 {
-    auto iter = _impl->attributes.find(name);
-    if (iter == _impl->attributes.end())
+    _impl->tag_filter = !names.empty();
+    _impl->interest_atoms.reset();
+    _impl->interest_names.clear();
+
+    for (const auto name : names)
     {
-        _impl->attributes[name] = value;
+        sc_string lower { name.data(), name.size() };
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](char_type ch) { return to_lower(ch); });
+
+        if (const auto atom = atom_of(lower); atom != no_atom)
+            _impl->interest_atoms.set(atom);
+        else
+            _impl->interest_names.push_back(std::move(lower));
     }
-    else
+}
+
+auto scrp::Tokenizer::set_tag_interest(std::initializer_list<std::string_view> names) -> void
+{
+    set_tag_interest(std::span { names.begin(), names.size() });
+}
+
+auto scrp::Tokenizer::source() const noexcept -> std::string_view
+{
+    return _impl->data;
+}
+
+auto scrp::Tokenizer::insert_attribute(const token_buffer &name, const token_buffer &value) -> void
+{
+    if (_impl->skip_tag)
+        return;
+
+    const auto name_view = name.view();
+    for (const auto &attr : _impl->attributes)
     {
-        emit_error(parser_error_type::duplicate_attribute);
-        // discard the new attribute
+        if (attr.name_view(_impl->data) == name_view)
+        {
+            emit_error(parser_error_type::duplicate_attribute);
+            // discard the new attribute
+            return;
+        }
     }
+
+    auto &attr      = _impl->attributes.emplace_back();
+    attr.name       = name.text;
+    attr.value      = value.text;
+    attr.name_span  = name.span;
+    attr.value_span = value.span;
+    attr.atom       = atom_of(name_view);
 }
 
-auto scrp::Tokenizer::is_next_char_eof(const sc_string::iterator &pos) const -> bool
+auto scrp::Tokenizer::is_next_char_eof(const input_iterator &pos) const -> bool
 {
-    return _impl->data.end() == std::next(pos);
+    // While streaming, the end of the buffer is not the end of the input
+    return _impl->end_of_input && _impl->data.end() == std::next(pos);
 }
 
 auto scrp::Tokenizer::is_char_lower_alpha(scrp::char_type ch) noexcept -> bool
 {
-    constexpr auto _llp = static_cast<scrp::char_type>(0x61);
-    constexpr auto _lup = static_cast<scrp::char_type>(0x7A);
-
-    return (ch >= _llp && ch <= _lup);
+    return scanner::has_class(ch, scanner::class_lower_alpha);
 }
 
 auto scrp::Tokenizer::is_char_upper_alpha(scrp::char_type ch) noexcept -> bool
 {
-    constexpr auto _ulp = static_cast<scrp::char_type>(0x41);
-    constexpr auto _uup = static_cast<scrp::char_type>(0x5A);
-
-    return (ch >= _ulp && ch <= _uup);
+    return scanner::has_class(ch, scanner::class_upper_alpha);
 }
 
 auto scrp::Tokenizer::is_char_alpha(scrp::char_type ch) noexcept -> bool
 {
-    return scrp::Tokenizer::is_char_lower_alpha(ch) || scrp::Tokenizer::is_char_upper_alpha(ch);
+    return scanner::has_class(ch, scanner::class_alpha);
 }
 
 auto scrp::Tokenizer::is_char_digit(scrp::char_type ch) noexcept -> bool
 {
-    constexpr auto _dlp = static_cast<scrp::char_type>(0x30);
-    constexpr auto _dup = static_cast<scrp::char_type>(0x39);
-
-    return (ch >= _dlp && ch <= _dup);
+    return scanner::has_class(ch, scanner::class_digit);
 }
 
 auto scrp::Tokenizer::is_char_alphanumeric(scrp::char_type ch) noexcept -> bool
 {
-    return scrp::Tokenizer::is_char_alpha(ch) || scrp::Tokenizer::is_char_digit(ch);
+    return scanner::has_class(ch, scanner::class_alphanumeric);
 }
 
 auto scrp::Tokenizer::is_char_lower_hex_digit(scrp::char_type ch) noexcept -> bool
 {
-    constexpr auto _hlp = static_cast<scrp::char_type>(0x61);
-    constexpr auto _hup = static_cast<scrp::char_type>(0x66);
-
-    return (ch >= _hlp && ch <= _hup);
+    return scanner::has_class(ch, scanner::class_lower_hex);
 }
 
 auto scrp::Tokenizer::is_char_upper_hex_digit(scrp::char_type ch) noexcept -> bool
 {
-    constexpr auto _hlp = static_cast<scrp::char_type>(0x41);
-    constexpr auto _hup = static_cast<scrp::char_type>(0x46);
-
-    return (ch >= _hlp && ch <= _hup);
+    return scanner::has_class(ch, scanner::class_upper_hex);
 }
 
 auto scrp::Tokenizer::is_char_hex_digit(scrp::char_type ch) noexcept -> bool
 {
-    return scrp::Tokenizer::is_char_lower_hex_digit(ch) || scrp::Tokenizer::is_char_upper_hex_digit(ch);
+    return scanner::has_class(ch, scanner::class_hex_digit);
+}
+
+auto scrp::Tokenizer::is_char_control(scrp::char_type ch) noexcept -> bool
+{
+    return scanner::has_class(ch, scanner::class_control);
 }
 
 auto scrp::Tokenizer::is_noncharacter(int64_t codepoint) noexcept -> bool
@@ -559,15 +1550,10 @@ auto scrp::Tokenizer::is_control_character(int64_t codepoint) noexcept -> bool
 
 auto scrp::Tokenizer::to_lower(scrp::char_type ch) noexcept -> scrp::char_type
 {
-    constexpr auto _hlp = static_cast<scrp::char_type>(0x41);
-    constexpr auto _llp = static_cast<scrp::char_type>(0x61);
-
-    if (scrp::Tokenizer::is_char_upper_alpha(ch))
-        return static_cast<scrp::char_type>(static_cast<int>(ch) - _hlp + _llp);
-    return ch;
+    return scanner::to_lower(ch);
 }
 
-auto scrp::Tokenizer::string_to_lower(sc_string &str) noexcept -> sc_string
+auto scrp::Tokenizer::string_to_lower(sc_string &str) -> sc_string
 {
     sc_string lower;
     lower.reserve(str.size());
@@ -575,132 +1561,321 @@ auto scrp::Tokenizer::string_to_lower(sc_string &str) noexcept -> sc_string
     return lower;
 }
 
+auto scrp::Tokenizer::match_keyword(const input_iterator &pos, std::string_view keyword, bool ignore_case) const noexcept -> std::size_t
+{
+    const auto available = static_cast<std::size_t>(std::distance(pos, _impl->data.end()));
+    const auto limit     = std::min(available, keyword.size());
+
+    std::size_t length = 0;
+    for (auto it = pos; length < limit; ++it, ++length)
+    {
+        if ((ignore_case ? to_lower(*it) : *it) != keyword[length])
+            break;
+    }
+
+    return length;
+}
+
 auto scrp::Tokenizer::current_position() const noexcept -> std::size_t
 {
-    return _impl->current_position;
+    return _impl->cursor_offset();
 }
 
 auto scrp::Tokenizer::current_line() const noexcept -> std::size_t
 {
-    return _impl->current_line;
+    return _impl->line_of(_impl->cursor_offset());
+}
+
+auto scrp::Tokenizer::current_line_offset() const noexcept -> std::size_t
+{
+    return _impl->column_of(_impl->cursor_offset());
+}
+auto scrp::Tokenizer::stop() noexcept -> void
+{
+    // end_of_file() does nothing once the input is finished
+    _impl->stopped  = true;
+    _impl->finished = true;
+}
+
+auto scrp::Tokenizer::stopped() const noexcept -> bool
+{
+    return _impl->stopped;
+}
+
+auto scrp::Tokenizer::get_parse_errors() const noexcept -> scrp::sc_vector<parser_error>
+{
+    sc_vector<parser_error> errors;
+    errors.reserve(_impl->errors.size());
+    for (const auto &error : _impl->errors)
+        errors.push_back(describe_error(error));
+    return errors;
+}
+
+auto scrp::Tokenizer::parse_errors() const noexcept -> std::span<const error_record>
+{
+    return { _impl->errors.data(), _impl->errors.size() };
+}
+
+auto scrp::Tokenizer::error_count() const noexcept -> std::size_t
+{
+    return _impl->error_total;
+}
+
+auto scrp::Tokenizer::describe_error(const error_record &error) const -> parser_error
+{
+    const auto offset = error.offset();
+    return { error.type(), offset, _impl->column_of(offset), _impl->line_of(offset) };
+}
+
+auto scrp::Tokenizer::set_error_policy(error_policy policy, std::size_t limit) -> void
+{
+    _impl->error_mode  = policy;
+    _impl->error_limit = limit;
+}
+
+auto scrp::Tokenizer::emit_error(parser_error_type type) -> void
+{
+    if (_impl->error_mode == error_policy::off)
+        return;
+
+    ++_impl->error_total;
+
+    // Only the offset is kept; the line and the column are computed when the error is read
+    assert(_impl->cursor_offset() <= error_record::max_offset);
+    _impl->keep_error({ _impl->cursor_offset(), type });
+}
+
+
+
+auto scrp::Tokenizer::emit_token(token_record &&token) -> void
+{
+    _impl->clear_token_data();
+
+    auto &tokens = _impl->tokens;
+
+    // Only character tokens wait to be consumed, and consecutive ones are merged, so at most the last token is pending
+    const bool pending_characters = !tokens.empty() && !tokens.back()->consumed;
+
+    if (token->type == TokenType::Character)
+    {
+        if (pending_characters)
+        {
+            const auto *this_tok = token.as<CharacterToken>();
+            _impl->append_characters(this_tok->span, this_tok->view(_impl->data));
+            return;
+        }
+
+        if (!_impl->within_budget(tokens))
+            return;
+
+        // Add the token
+        tokens.push_back(std::move(token));
+        // Do not consume it
+        return;
+    }
+
+    if(token->type == TokenType::Tag && _impl->end_tag)
+    {
+        auto *this_tok = token.as<TagToken>();
+
+        this_tok->set_end_tag();
+
+       if (!this_tok->attributes.empty())
+       {
+            emit_error(parser_error_type::end_tag_with_attributes);
+            // Don't pass the attributes to the parser
+            this_tok->attributes = {};
+       }
+
+       _impl->end_tag = false;
+    }
+    else if( token->type != TokenType::Tag && _impl->end_tag )
+       _impl->end_tag = false;
+
+
+    // Consume the characters that were not consumed
+    if (pending_characters)
+        deliver_token(tokens.back());
+
+    if (_impl->buffer_segment)
+    {
+        std::move(tokens.begin(), tokens.end(), std::back_inserter(_impl->segment_tokens));
+        tokens.clear();
+        deliver_token(_impl->segment_tokens.emplace_back(std::move(token)));
+        return;
+    }
+
+    if (!_impl->within_budget(tokens))
+        return;
+
+    tokens.push_back(std::move(token));
+    deliver_token(tokens.back());
+
+    if (_impl->parser != nullptr && !_impl->keep_tokens)
+        _impl->drop_tokens();
+}
+
+auto scrp::Tokenizer::deliver_token(token_record &token) -> void
+{
+    // The state that called stop() can still emit a few tokens before run() gets back control
+    if (_impl->stopped)
+        return;
+
+    ++_impl->delivered_tokens;
+
+    // Without a parser the token stays in the buffer until next() gives it
+    token->consumed = true;
+
+    if (_impl->parser != nullptr)
+        _impl->parser->consume_token(token);
+}
+
+auto scrp::Tokenizer::emit_end_tag_token() -> void
+{
+    _impl->end_tag = true;
+}
+
+auto scrp::Tokenizer::emit_character_run(const input_iterator &first, std::size_t length) -> void
+{
+    const source_span span { static_cast<std::size_t>(first - _impl->data.begin()), length };
+
+    if (_impl->append_characters(_impl->use_spans ? span : source_span {}, { &*first, length }))
+        return;
+
+    if (_impl->use_spans)
+    {
+        token_record token { std::in_place_type<CharacterToken>, sc_string {} };
+        token.as<CharacterToken>()->span = span;
+        emit_token(std::move(token));
+    }
+    else
+        emit_token<CharacterToken>(sc_string { &*first, length });
 }
 
-auto scrp::Tokenizer::current_line_offset() const noexcept -> std::size_t
-{
-    return _impl->current_line;
-}
-auto scrp::Tokenizer::get_parse_errors() const noexcept -> scrp::sc_vector<parser_error>
+auto scrp::Tokenizer::emit_characters(std::string_view text) -> void
 {
-    return _impl->errors;
+    if (!_impl->append_characters({}, text))
+        emit_token<CharacterToken>(sc_string { text.data(), text.size() });
 }
 
-auto scrp::Tokenizer::emit_error(parser_error_type type) noexcept -> void
+auto scrp::Tokenizer::emit_current_comment_token() -> void
 {
-    _impl->errors.emplace_back(type, _impl->current_position, _impl->line_offset, _impl->current_line);
+    token_record token { std::in_place_type<CommentToken>, _impl->current_token_data.text };
+    token.as<CommentToken>()->span = _impl->current_token_data.span;
+    emit_token(std::move(token));
 }
 
-
-
-auto scrp::Tokenizer::emit_token(Token *token) noexcept -> void
+auto scrp::Tokenizer::emit_current_tag_token(bool self_closing) -> void
 {
-    assert(_impl->parser != nullptr);
-
-    _impl->current_token_data.clear();
-    _impl->extra_token_data_0.clear();
-    _impl->extra_token_data_1.clear();
-    _impl->attributes.clear();
-
-    if (!_impl->tokens.empty() && _impl->tokens.back()->type == TokenType::Character && token->type == TokenType::Character)
-    {
-        // Merge characters
-        auto this_tok = dynamic_cast<CharacterToken *>(token);
-        auto last_tok = dynamic_cast<CharacterToken *>(_impl->tokens.back());
+    const auto name = _impl->current_token_data.view();
+    const auto atom = atom_of(name);
 
-        last_tok->code_point += this_tok->code_point;
-
-        release_token(token);
-        return;
-    }
-    else
+    // Every text element has an atom
+    if (!_impl->end_tag && atom != no_atom)
     {
-        if (token->type == TokenType::Character)
+        for (const auto &element : text_elements)
         {
-            // Add the token
-            _impl->tokens.push_back(token);
-            // Do not consume it
-            return;
+            if (element.atom == atom)
+            {
+                _impl->content_state = element.state;
+                _impl->content_tag   = element.name;
+                break;
+            }
         }
     }
 
-    if(token->type == TokenType::Tag && _impl->end_tag)
+    if (_impl->skip_tag)
     {
-        auto this_tok = dynamic_cast<TagToken *>(token);
-
-        this_tok->set_end_tag();
-
-       if (!this_tok->attributes.empty())
-       {
-            emit_error(parser_error_type::end_tag_with_attributes);
-            // Don't pass the attributes to the parser
-            this_tok->attributes.clear();
-       }
+        // Nobody reads the tag, but the text before it is complete all the same
+        auto &tokens = _impl->tokens;
+        if (!tokens.empty() && !tokens.back()->consumed)
+            deliver_token(tokens.back());
 
-       _impl->end_tag = false;
+        _impl->current_token_data.clear();
+        _impl->extra_token_data_0.clear();
+        _impl->extra_token_data_1.clear();
+        _impl->attributes.clear();
+        _impl->end_tag  = false;
+        _impl->skip_tag = false;
+        return;
     }
-    else if( token->type != TokenType::Tag && _impl->end_tag )
-       _impl->end_tag = false;
 
+    const auto attributes = _impl->stored_attributes.store({ _impl->attributes.begin(), _impl->attributes.size() });
 
-    // Consume all not consumed tokens
-    for (auto &unconsumed_tokens : _impl->tokens)
-    {
-        if (!unconsumed_tokens->consumed)
-        {
-            _impl->parser->consume_token(unconsumed_tokens);
-            unconsumed_tokens->consumed = true;
-        }
+    token_record token { std::in_place_type<TagToken>, _impl->current_token_data.text, attributes, self_closing };
+    token.as<TagToken>()->name_span = _impl->current_token_data.span;
+    token.as<TagToken>()->atom      = atom;
+    emit_token(std::move(token));
+}
 
-        if (!_impl->keep_tokens)
-            release_token(unconsumed_tokens);
-    }
+auto scrp::Tokenizer::insert_character_to_string(token_buffer &name, const sc_string &str) -> void
+{
+    for (const auto &ch : str)
+        insert_character_to_string(name, ch);
+}
 
-    if (!_impl->keep_tokens)
-        _impl->tokens.clear();
+auto scrp::Tokenizer::insert_character_to_string(token_buffer &name, std::string_view str) -> void
+{
+    for (const auto &ch : str)
+        insert_character_to_string(name, ch);
+}
 
-    _impl->parser->consume_token(token);
-    token->consumed = true;
+auto scrp::Tokenizer::insert_character_to_string(token_buffer &name, char_type ch) -> void
+{
+    if (scanner::has_class(ch, scanner::class_stream_control))
+        emit_error(parser_error_type::control_character_in_input_stream);
 
-    if (_impl->keep_tokens)
-    {
-        _impl->tokens.push_back(token);
-    }
-    else
-        release_token(token);
+    name.append(ch);
 }
 
-auto scrp::Tokenizer::emit_end_tag_token() -> void
+auto scrp::Tokenizer::insert_source_character(token_buffer &name, const input_iterator &pos, char_type ch) -> void
 {
-    _impl->end_tag = true;
+    if (scanner::has_class(ch, scanner::class_stream_control))
+        emit_error(parser_error_type::control_character_in_input_stream);
+
+    name.append_source(static_cast<std::size_t>(pos - _impl->data.begin()), ch);
 }
 
-auto scrp::Tokenizer::insert_character_to_string(sc_string &name, const sc_string &str) -> void
+auto scrp::Tokenizer::insert_source_run(token_buffer &name, input_iterator &pos, uint16_t delimiters) -> void
 {
-    for (const auto &ch : str)
-        insert_character_to_string(name, ch);
+    insert_source_character(name, pos, *pos);
+
+    // The characters up to the next one the state must see on its own need no checks: append them at once
+    const auto *first = std::next(pos);
+    const auto *last  = scanner::find_class(first, _impl->data.data() + _impl->run_limit, delimiters | scanner::class_stream_control);
+
+    if (first != last)
+        name.append_source_run(static_cast<std::size_t>(first - _impl->data.begin()), { first, static_cast<std::size_t>(last - first) });
+
+    // run() will step past the last character of the run
+    pos = std::prev(last);
 }
 
-auto scrp::Tokenizer::insert_character_to_string(sc_string &name, std::string_view str) -> void
+auto scrp::Tokenizer::insert_name_run(token_buffer &name, input_iterator &pos, bool attribute_name) -> void
 {
-    for (const auto &ch : str)
-        insert_character_to_string(name, ch);
+    insert_source_character(name, pos, to_lower(*pos));
+
+    const auto *first = std::next(pos);
+    const auto *last  = scanner::find_name_end(first, _impl->data.data() + _impl->run_limit, attribute_name);
+
+    // The span of the buffer can only hold the characters before the first upper case letter; the rest is folded in blocks
+    const auto *upper = name.use_spans ? scanner::find_class(first, last, scanner::class_upper_alpha) : first;
+    if (first != upper)
+        name.append_source_run(static_cast<std::size_t>(first - _impl->data.begin()), { first, static_cast<std::size_t>(upper - first) });
+    if (upper != last)
+        name.append_lower({ upper, static_cast<std::size_t>(last - upper) });
+
+    // run() will step past the last character of the run
+    pos = std::prev(last);
 }
 
-auto scrp::Tokenizer::insert_character_to_string(sc_string &name, char_type ch) -> void
+auto scrp::Tokenizer::skip_source_run(input_iterator &pos, uint16_t delimiters) -> void
 {
-    if (is_control_character(ch))
+    if (scanner::has_class(*pos, scanner::class_stream_control))
         emit_error(parser_error_type::control_character_in_input_stream);
 
-    name += ch;
+    // run() will step past the last character of the run
+    pos = std::prev(scanner::find_class(std::next(pos), _impl->data.data() + _impl->run_limit, delimiters | scanner::class_stream_control));
 }
 
 auto scrp::Tokenizer::handle_eof_error(scrp::States stateChange) -> void
@@ -717,7 +1892,7 @@ auto scrp::Tokenizer::handle_eof_error(scrp::States stateChange) -> void
             [[fallthrough]];
         case States::CommentEndDash:
             emit_error(parser_error_type::eof_in_comment);
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             emit_eof_token();
             break;
         case States::DOCTYPE:
@@ -746,11 +1921,21 @@ auto scrp::Tokenizer::handle_eof_error(scrp::States stateChange) -> void
             [[fallthrough]];
         case States::BogusDOCTYPE:
             emit_error(parser_error_type::eof_in_doctype);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
             emit_eof_token();
             break;
+        case States::CharacterReference:
+            // The input ended right after the ampersand
+            flush_ampersand();
+            if (!is_return_state_attribute())
+                emit_eof_token();
+            leave_character_reference();
+            break;
         case States::Data: [[fallthrough]];
-        case States::CharacterReference: [[fallthrough]];
+        case States::RCDATA: [[fallthrough]];
+        case States::RAWTEXT: [[fallthrough]];
+        case States::ScriptData: [[fallthrough]];
+        case States::PLAINTEXT: [[fallthrough]];
         case States::NamedCharacterReference: [[fallthrough]];
         case States::NumericCharacterReference: [[fallthrough]];
         case States::HexadecimalCharacterReferenceStart: [[fallthrough]];
@@ -787,8 +1972,16 @@ auto scrp::Tokenizer::handle_eof_error(scrp::States stateChange) -> void
     }
 }
 
-auto scrp::Tokenizer::data_state(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::data_state(input_iterator &pos, States &stateChange) -> void
 {
+    if (_impl->content_state != States::Data)
+    {
+        // The contents of the element just opened are not markup
+        stateChange = std::exchange(_impl->content_state, States::Data);
+        --pos;
+        return;
+    }
+
     switch (*pos)
     {
         case '&':
@@ -802,7 +1995,17 @@ auto scrp::Tokenizer::data_state(sc_string::iterator &pos, States &stateChange)
             emit_error(parser_error_type::unexpected_null_character);
             break;
         default:
-            emit_character_token(sc_string { *pos });
+            {
+                // Emit the whole run of plain text up to the next character that the data state must see on its own
+                const auto *first = &*pos;
+                const auto *last  = scanner::find_data_delimiter(first + 1, _impl->data.data() + _impl->run_limit);
+                const auto length = static_cast<std::size_t>(last - first);
+
+                emit_character_run(pos, length);
+
+                // run() will step past the last character of the run
+                pos += static_cast<std::ptrdiff_t>(length - 1);
+            }
             break;
     }
 
@@ -812,7 +2015,77 @@ auto scrp::Tokenizer::data_state(sc_string::iterator &pos, States &stateChange)
     }
 }
 
-auto scrp::Tokenizer::tag_open_state(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::rcdata_state(input_iterator &pos, States &stateChange) -> void
+{
+    switch (*pos)
+    {
+        case '&':
+            stateChange = States::CharacterReference;
+            _impl->state.push(States::RCDATA);
+            return;
+        case '<':
+            if (scanner::find_end_tag(pos, std::next(pos), _impl->data.end(), _impl->content_tag) == pos)
+            {
+                // The data state tokenizes the end tag
+                stateChange = States::Data;
+                --pos;
+                return;
+            }
+            emit_character_run(pos, 1);
+            break;
+        case 0:
+            emit_error(parser_error_type::unexpected_null_character);
+            emit_characters(encoding::_sv_invalid);
+            break;
+        default:
+            {
+                const auto *last  = scanner::find_data_delimiter(std::next(pos), _impl->data.data() + _impl->run_limit);
+                const auto length = static_cast<std::size_t>(last - pos);
+
+                emit_character_run(pos, length);
+
+                // run() will step past the last character of the run
+                pos += static_cast<std::ptrdiff_t>(length - 1);
+            }
+            break;
+    }
+
+    if (is_next_char_eof(pos))
+        emit_eof_token();
+}
+
+auto scrp::Tokenizer::rawtext_state(input_iterator &pos, States &stateChange) -> void
+{
+    // Everything up to the end tag is text, so it is found without going through the states. PLAINTEXT has no end.
+    // The escapes of script data (<!-- and a nested <script>) are not tracked: the first </script> ends the script
+    const auto *last    = _impl->data.data() + _impl->run_limit;
+    const auto *end_tag = stateChange == States::PLAINTEXT ? last : scanner::find_end_tag(pos, last, _impl->data.end(), _impl->content_tag);
+
+    for (;;)
+    {
+        const auto *null = std::find(pos, end_tag, char_type { 0 });
+        if (null != pos)
+            emit_character_run(pos, static_cast<std::size_t>(null - pos));
+
+        pos = null;
+        if (pos == end_tag)
+            break;
+
+        emit_error(parser_error_type::unexpected_null_character);
+        emit_characters(encoding::_sv_invalid);
+        ++pos;
+    }
+
+    // run() will step to pos: the end tag, which the data state tokenizes, or the first character not scanned yet
+    if (end_tag != last)
+        stateChange = States::Data;
+    --pos;
+
+    if (end_tag == last && is_next_char_eof(pos))
+        emit_eof_token();
+}
+
+auto scrp::Tokenizer::tag_open_state(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -837,7 +2110,7 @@ auto scrp::Tokenizer::tag_open_state(sc_string::iterator &pos, States &stateChan
             else
             {
                 emit_error(parser_error_type::invalid_first_character_of_tag_name);
-                emit_character_token("<");
+                emit_characters("<");
                 stateChange = States::Data;
                 --pos;
             }
@@ -847,12 +2120,12 @@ auto scrp::Tokenizer::tag_open_state(sc_string::iterator &pos, States &stateChan
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_before_tag_name);
-        emit_character_token(">");
+        emit_characters(">");
         emit_eof_token();
     }
 }
 
-auto scrp::Tokenizer::character_reference(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::character_reference(input_iterator &pos, scrp::States &stateChange) -> void
 {
 
     switch (*pos)
@@ -860,112 +2133,70 @@ auto scrp::Tokenizer::character_reference(sc_string::iterator &pos, scrp::States
         case '#':
             stateChange              = States::NumericCharacterReference;
             _impl->numeric_reference = 0;
-            _impl->named_reference.clear();
             break;
         default:
             if (is_char_alphanumeric(*pos))
             {
-                _impl->named_reference.clear();
-                _impl->last_char_reference = encoding::null_chref;
-                stateChange                = States::NamedCharacterReference;
+                stateChange = States::NamedCharacterReference;
                 --pos;
             }
             else
             {
-                if (!_impl->state.empty() && _impl->state.top() != States::Data)
-                    stateChange = _impl->state.top();
-                else
-                    stateChange = States::Data;
+                // Not a character reference
+                flush_ampersand();
+                stateChange = leave_character_reference();
                 --pos;
             }
     }
 }
 
-auto scrp::Tokenizer::named_character_reference(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::named_character_reference(input_iterator &pos, States &stateChange) -> void
 {
-    const auto &ch = *pos;
-
-    // NOTE: this part is not compliant with the standard, however, the output is the same
+    // Consume the longest reference that starts at pos. While streaming, feed() holds back enough characters for it
+    const auto available = static_cast<std::size_t>(std::distance(pos, _impl->data.end()));
+    const auto match     = encoding::match_reference({ &*pos, std::min(available, encoding::max_reference_size) });
 
-    // Keep adding the character
-    _impl->named_reference += ch;
-
-    const auto &current_ref = encoding::find_reference(_impl->named_reference);
-
-    if (current_ref != encoding::null_chref)
+    if (match.reference == nullptr)
     {
-        // Up to this point, this code will match for example &notin;, &notinE; &notindot; ..., as &not
-        // Because &not is not mandatory with a semicolon, we must change this
-        if (_impl->named_reference.back() != ';')
-        {
-            // Keep this reference
-            _impl->last_char_reference = current_ref;
-            // Keep track of the position of string in case we must flush this character reference and flush
-            _impl->numeric_reference = static_cast<uint32_t>(_impl->named_reference.size());
-            // Keep gathering characters
-            return;
-        }
+        flush_ampersand();
+        stateChange = States::AmbiguousAmpersand;
+        --pos;
+        return;
     }
 
-    // Stop getting the character reference when it encounters a non alpha character except for the semicolon.
+    const auto last           = std::next(pos, static_cast<std::ptrdiff_t>(match.length - 1));
+    const auto next           = std::next(last);
+    const bool with_semicolon = *last == ';';
 
-    if ((is_char_alpha(ch) || ch != ';') && current_ref == encoding::null_chref)
+    if (!with_semicolon && is_return_state_attribute() && next != _impl->data.end() && (*next == '=' || is_char_alphanumeric(*next)))
     {
-        // Keep gathering information only if ch != ';'
-        if (ch != ';')
-            return;
-        // In the other case keep going
+        // For historical reasons, this is not a character reference inside an attribute value
+        flush_ampersand();
+        for (auto it = pos; it != next; ++it)
+            insert_source_character(_impl->extra_token_data_1, it, *it);
     }
-
-    if (current_ref == encoding::null_chref)
+    else
     {
-        // We reach a non alpha character and find_reference didn't catch a character reference
-        if (is_return_state_attribute()) // it doesn't matter if _impl->last_char_reference is not null_chref
-        {
-            // Not an error, just keep push the data in the
-            const sc_string to_token_value = sc_string { "&" } + _impl->named_reference;
-            insert_character_to_string(_impl->extra_token_data_1, to_token_value);
+        if (!with_semicolon)
+            emit_error(parser_error_type::missing_semicolon_after_character_reference);
 
-            // Go back to the return state
-            // since is_return_state_attribute() -> true; it is certain that _impl->state is not empty
-            stateChange = _impl->state.top();
-        }
+        const auto &utf8_encoding = match.reference->utf8_encoding;
+        if (is_return_state_attribute())
+            insert_character_to_string(_impl->extra_token_data_1, utf8_encoding);
         else
-        {
-            if (_impl->last_char_reference != encoding::null_chref)
-            {
-                // Emit the last_char_reference
-                emit_character_token(_impl->last_char_reference.utf8_encoding.data());
-                emit_character_token(_impl->named_reference.substr(_impl->numeric_reference, _impl->named_reference.size()));
-
-                stateChange = States::Data;
-            }
-            else
-            {
-                stateChange = States::AmbiguousAmpersand;
-            }
-        }
+            emit_characters(utf8_encoding);
     }
-    else
-    {
-        if (is_return_state_attribute())
-        {
-            insert_character_to_string(_impl->extra_token_data_1, current_ref.utf8_encoding);
 
-            // Go back to the return state
-            // since is_return_state_attribute() -> true; it is certain that _impl->state is not empty
-            stateChange = _impl->state.top();
-        }
-        else
-        {
-            emit_character_token(_impl->last_char_reference.utf8_encoding.data());
+    // run() will step past the last character of the reference
+    pos = last;
 
-            stateChange = States::Data;
-        }
-    }
+    if (is_next_char_eof(pos) && !is_return_state_attribute())
+        emit_eof_token();
+
+    stateChange = leave_character_reference();
 }
 
-auto scrp::Tokenizer::numeric_character_reference(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::numeric_character_reference(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -978,7 +2209,7 @@ auto scrp::Tokenizer::numeric_character_reference(sc_string::iterator &pos, Stat
     }
 }
 
-auto scrp::Tokenizer::hexadecimal_character_reference_start(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::hexadecimal_character_reference_start(input_iterator &pos, States &stateChange) -> void
 {
     if (is_char_hex_digit(*pos))
     {
@@ -988,19 +2219,16 @@ auto scrp::Tokenizer::hexadecimal_character_reference_start(sc_string::iterator
     else
     {
         emit_error(parser_error_type::absence_of_digits_in_numeric_character_reference);
-        if (!_impl->state.empty())
-            stateChange = _impl->state.top();
-        else
-            stateChange = States::Data;
 
-        if (stateChange != States::Data)
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+        if (is_return_state_attribute())
+            insert_source_character(_impl->extra_token_data_1, pos, *pos);
 
+        stateChange = leave_character_reference();
         --pos;
     }
 }
 
-auto scrp::Tokenizer::decimal_character_reference_start(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::decimal_character_reference_start(input_iterator &pos, States &stateChange) -> void
 {
     if (is_char_digit(*pos))
     {
@@ -1010,19 +2238,16 @@ auto scrp::Tokenizer::decimal_character_reference_start(sc_string::iterator &pos
     else
     {
         emit_error(parser_error_type::absence_of_digits_in_numeric_character_reference);
-        if (!_impl->state.empty())
-            stateChange = _impl->state.top();
-        else
-            stateChange = States::Data;
 
-        if (stateChange != States::Data)
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+        if (is_return_state_attribute())
+            insert_source_character(_impl->extra_token_data_1, pos, *pos);
 
+        stateChange = leave_character_reference();
         --pos;
     }
 }
 
-auto scrp::Tokenizer::hexadecimal_character_reference(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::hexadecimal_character_reference(input_iterator &pos, States &stateChange) -> void
 {
     const auto &ch = *pos;
     if (is_char_digit(ch))
@@ -1052,7 +2277,7 @@ auto scrp::Tokenizer::hexadecimal_character_reference(sc_string::iterator &pos,
     }
 }
 
-auto scrp::Tokenizer::decimal_character_reference(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::decimal_character_reference(input_iterator &pos, States &stateChange) -> void
 {
     const auto &ch = *pos;
     if (is_char_digit(ch))
@@ -1072,7 +2297,7 @@ auto scrp::Tokenizer::decimal_character_reference(sc_string::iterator &pos, Stat
     }
 }
 
-auto scrp::Tokenizer::numeric_character_reference_end(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::numeric_character_reference_end(input_iterator &pos, States &stateChange) -> void
 {
     if (_impl->numeric_reference == 0)
     {
@@ -1130,106 +2355,119 @@ auto scrp::Tokenizer::numeric_character_reference_end(sc_string::iterator &pos,
         }
     }
 
-    if (!_impl->state.empty())
-        stateChange = _impl->state.top();
-    else
-        stateChange = States::Data;
-
     const auto utf8_character_reference = encoding::rt_to_utf8(_impl->numeric_reference);
-    if (stateChange != States::Data)
+    if (is_return_state_attribute())
     {
         insert_character_to_string(_impl->extra_token_data_1, encoding::rt_to_view(utf8_character_reference));
     }
     else
     {
-        emit_character_token(encoding::rt_to_view(utf8_character_reference));
+        const auto text = encoding::rt_to_view(utf8_character_reference);
+        emit_characters({ text.data(), text.size() });
     }
+
+    stateChange = leave_character_reference();
 }
 
-auto scrp::Tokenizer::ambiguous_ampersand(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::ambiguous_ampersand(input_iterator &pos, States &stateChange) -> void
 {
-    if (!is_return_state_attribute())
-    {
-        emit_error(parser_error_type::unknown_named_character_reference);
-    }
-    else
+    if (is_char_alphanumeric(*pos))
     {
-        const sc_string to_token_value = sc_string { "&" } + _impl->named_reference;
-        insert_character_to_string(_impl->extra_token_data_1, to_token_value);
-    }
+        // Take the whole run of alphanumeric characters at once
+        const auto end = std::next(_impl->data.begin(), static_cast<std::ptrdiff_t>(_impl->run_limit));
+        auto last      = pos;
+        while (std::next(last) != end && is_char_alphanumeric(*std::next(last)))
+            ++last;
 
-    if (!_impl->state.empty() && _impl->state.top() != States::Data)
-        stateChange = _impl->state.top();
+        const auto length = static_cast<std::size_t>(std::distance(pos, last)) + 1;
 
-    stateChange = _impl->state.top();
-    _impl->state.pop();
+        if (is_return_state_attribute())
+        {
+            for (auto it = pos; it != std::next(last); ++it)
+                insert_source_character(_impl->extra_token_data_1, it, *it);
+        }
+        else
+            emit_character_run(pos, length);
 
+        pos = last;
+
+        if (is_next_char_eof(pos) && !is_return_state_attribute())
+            emit_eof_token();
+        return;
+    }
+
+    if (*pos == ';')
+        emit_error(parser_error_type::unknown_named_character_reference);
+
+    stateChange = leave_character_reference();
     --pos;
 }
 
-auto scrp::Tokenizer::markup_declaration_open(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::flush_ampersand() -> void
+{
+    if (is_return_state_attribute())
+        insert_character_to_string(_impl->extra_token_data_1, '&');
+    else
+        emit_characters("&");
+}
+
+auto scrp::Tokenizer::leave_character_reference() -> States
 {
-    sc_string markup_name;
-    markup_name.reserve(32);
-    bool test_for_comment = false;
-    bool keep_testing     = true;
+    if (_impl->state.empty())
+        return States::Data;
 
+    const auto return_state = _impl->state.top();
+    _impl->state.pop();
+    return return_state;
+}
+
+auto scrp::Tokenizer::markup_declaration_open(input_iterator &pos, States &stateChange) -> void
+{
     static constexpr std::string_view _doctype { "doctype" };
     static constexpr std::string_view _cdata { "[CDATA[" };
 
-    for (; pos != _impl->data.end(); ++pos)
+    if (*pos == '-' && !is_next_char_eof(pos) && *std::next(pos) == '-')
     {
-        const auto &ch = *pos;
-        if (ch == '-' && !is_next_char_eof(pos) && *std::next(pos) == '-')
-        {
-            ++pos;
-            stateChange = States::CommentStart;
-            return;
-        }
-        else
-        {
-            markup_name += ch;
+        ++pos;
+        stateChange = States::CommentStart;
+        return;
+    }
 
-            auto lower = string_to_lower(markup_name);
-            auto ads   = _cdata.substr(0, markup_name.size());
-            if (markup_name.size() <= _doctype.size() && string_to_lower(markup_name) == _doctype.substr(0, markup_name.size()))
-            {
-                if (string_to_lower(markup_name) == _doctype)
-                {
-                    stateChange = States::DOCTYPE;
-                    return;
-                }
-            }
-            else if (markup_name.size() <= _cdata.size() && markup_name == _cdata.substr(0, markup_name.size()))
-            {
-                if (markup_name == _cdata)
-                {
-                    // TODO: CHECK CDATA BOGUS COMMENT
-                    stateChange = States::CDATASection;
-                    return;
-                }
-            }
-            else
-            {
+    // Both keywords are shorter than the streaming lookahead, so the buffer holds them if the input does
+    const auto doctype_length = match_keyword(pos, _doctype, true);
+    if (doctype_length == _doctype.size())
+    {
+        pos += static_cast<std::ptrdiff_t>(doctype_length - 1);
+        stateChange = States::DOCTYPE;
+        return;
+    }
 
-                emit_error(parser_error_type::incorrectly_opened_comment);
-                stateChange = States::BogusComment;
-                markup_name.pop_back();
-                _impl->current_token_data.clear();
-                insert_character_to_string(_impl->current_token_data, markup_name);
-                --pos;
-                return;
-            }
-        }
+    const auto cdata_length = match_keyword(pos, _cdata, false);
+    if (cdata_length == _cdata.size())
+    {
+        // TODO: CHECK CDATA BOGUS COMMENT
+        pos += static_cast<std::ptrdiff_t>(cdata_length - 1);
+        stateChange = States::CDATASection;
+        return;
     }
+
+    // The characters that matched a keyword start the comment; the first one that did not is reconsumed
+    const auto length = std::max(doctype_length, cdata_length);
+
+    emit_error(parser_error_type::incorrectly_opened_comment);
+    stateChange = States::BogusComment;
+    _impl->current_token_data.clear();
+    for (std::size_t i = 0; i < length; ++i, ++pos)
+        insert_source_character(_impl->current_token_data, pos, *pos);
+    --pos;
 }
 
-auto scrp::Tokenizer::bogus_comment(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::bogus_comment(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
         case '>':
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             stateChange = States::Data;
             break;
         case '0':
@@ -1237,11 +2475,11 @@ auto scrp::Tokenizer::bogus_comment(sc_string::iterator &pos, States &stateChang
             insert_character_to_string(_impl->current_token_data, encoding::_sv_invalid);
             break;
         default:
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
     }
 }
 
-auto scrp::Tokenizer::comment_start(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment_start(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1250,7 +2488,7 @@ auto scrp::Tokenizer::comment_start(sc_string::iterator &pos, scrp::States &stat
             break;
         case '>':
             emit_error(parser_error_type::abrupt_closing_of_empty_comment);
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             stateChange = States::Data;
             break;
         default:
@@ -1259,7 +2497,7 @@ auto scrp::Tokenizer::comment_start(sc_string::iterator &pos, scrp::States &stat
     }
 }
 
-auto scrp::Tokenizer::comment_start_dash(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment_start_dash(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1268,7 +2506,7 @@ auto scrp::Tokenizer::comment_start_dash(sc_string::iterator &pos, scrp::States
             break;
         case '>':
             emit_error(parser_error_type::abrupt_closing_of_empty_comment);
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             stateChange = States::Data;
             break;
         default:
@@ -1279,12 +2517,12 @@ auto scrp::Tokenizer::comment_start_dash(sc_string::iterator &pos, scrp::States
     }
 }
 
-auto scrp::Tokenizer::comment(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
         case '<':
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
             stateChange = States::CommentLessThanSign;
             break;
         case '-':
@@ -1295,20 +2533,20 @@ auto scrp::Tokenizer::comment(sc_string::iterator &pos, scrp::States &stateChang
             insert_character_to_string(_impl->current_token_data, encoding::_sv_invalid);
             break;
         default:
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_run(_impl->current_token_data, pos, scanner::class_comment_end);
     }
 }
 
-auto scrp::Tokenizer::comment_less_than_sign(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment_less_than_sign(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
         case '!':
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
             stateChange = States::CommentLessThanSignBang;
             break;
         case '<':
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
             break;
         default:
             --pos;
@@ -1316,7 +2554,7 @@ auto scrp::Tokenizer::comment_less_than_sign(sc_string::iterator &pos, scrp::Sta
     }
 }
 
-auto scrp::Tokenizer::comment_less_than_sign_bang(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::comment_less_than_sign_bang(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1329,7 +2567,7 @@ auto scrp::Tokenizer::comment_less_than_sign_bang(sc_string::iterator &pos, Stat
     }
 }
 
-auto scrp::Tokenizer::comment_less_than_sign_bang_dash(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::comment_less_than_sign_bang_dash(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1348,7 +2586,7 @@ auto scrp::Tokenizer::comment_less_than_sign_bang_dash(sc_string::iterator &pos,
     }
 }
 
-auto scrp::Tokenizer::comment_less_than_sign_bang_dash_dash(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::comment_less_than_sign_bang_dash_dash(input_iterator &pos, States &stateChange) -> void
 {
 
     switch (*pos)
@@ -1370,13 +2608,13 @@ auto scrp::Tokenizer::comment_less_than_sign_bang_dash_dash(sc_string::iterator
     }
 }
 
-auto scrp::Tokenizer::comment_end_dash(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment_end_dash(input_iterator &pos, scrp::States &stateChange) -> void
 {
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_comment);
         stateChange = States::Data; // Prevent the call to handle_eof_error()
-        emit_comment_token(_impl->current_token_data);
+        emit_current_comment_token();
         emit_eof_token();
     }
 
@@ -1386,27 +2624,27 @@ auto scrp::Tokenizer::comment_end_dash(sc_string::iterator &pos, scrp::States &s
             stateChange = States::CommentEnd;
             break;
         default:
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
             --pos;
             stateChange = States::Comment;
     }
 }
 
-auto scrp::Tokenizer::comment_end(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::comment_end(input_iterator &pos, scrp::States &stateChange) -> void
 {
 
     using namespace std::string_view_literals;
     switch (*pos)
     {
         case '>':
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             stateChange = States::Data;
             break;
         case '!':
             stateChange = States::CommentEndBang;
             break;
         case '-':
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
             break;
         default:
             --pos;
@@ -1417,13 +2655,13 @@ auto scrp::Tokenizer::comment_end(sc_string::iterator &pos, scrp::States &stateC
     if (is_next_char_eof(pos) && stateChange != States::Data && stateChange != States::CommentEndBang && stateChange != States::Comment)
     {
         emit_error(parser_error_type::eof_in_comment);
-        emit_comment_token(_impl->current_token_data);
+        emit_current_comment_token();
         emit_eof_token();
         return;
     }
 }
 
-auto scrp::Tokenizer::comment_end_bang(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::comment_end_bang(input_iterator &pos, States &stateChange) -> void
 {
     using namespace std::string_view_literals;
     switch (*pos)
@@ -1434,7 +2672,7 @@ auto scrp::Tokenizer::comment_end_bang(sc_string::iterator &pos, States &stateCh
             break;
         case '>':
             emit_error(parser_error_type::incorrectly_closed_comment);
-            emit_comment_token(_impl->current_token_data);
+            emit_current_comment_token();
             stateChange = States::Data;
             break;
         default:
@@ -1444,7 +2682,7 @@ auto scrp::Tokenizer::comment_end_bang(sc_string::iterator &pos, States &stateCh
     }
 }
 
-auto scrp::Tokenizer::doctype(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1458,6 +2696,8 @@ auto scrp::Tokenizer::doctype(sc_string::iterator &pos, scrp::States &stateChang
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1465,7 +2705,7 @@ auto scrp::Tokenizer::doctype(sc_string::iterator &pos, scrp::States &stateChang
     }
 }
 
-auto scrp::Tokenizer::before_doctype_name(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::before_doctype_name(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1473,6 +2713,8 @@ auto scrp::Tokenizer::before_doctype_name(sc_string::iterator &pos, States &stat
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1485,19 +2727,19 @@ auto scrp::Tokenizer::before_doctype_name(sc_string::iterator &pos, States &stat
             break;
         case '>':
             emit_error(parser_error_type::missing_doctype_name);
-            emit_doctype_token(_impl->current_token_data, true);
+            emit_doctype_token(_impl->current_token_data.str(), true);
             stateChange = States::Data;
             break;
         default:
             auto ch = *pos;
             if (is_char_upper_alpha(ch))
                 ch = to_lower(ch);
-            insert_character_to_string(_impl->current_token_data, ch);
+            insert_source_character(_impl->current_token_data, pos, ch);
             stateChange = States::DOCTYPEName;
     }
 }
 
-auto scrp::Tokenizer::doctype_name(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype_name(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1505,13 +2747,15 @@ auto scrp::Tokenizer::doctype_name(sc_string::iterator &pos, scrp::States &state
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
             stateChange = States::AfterDOCTYPEName;
             break;
         case '>':
-            emit_doctype_token(_impl->current_token_data);
+            emit_doctype_token(_impl->current_token_data.str());
             stateChange = States::Data;
             break;
         case 0:
@@ -1519,11 +2763,12 @@ auto scrp::Tokenizer::doctype_name(sc_string::iterator &pos, scrp::States &state
             insert_character_to_string(_impl->current_token_data, encoding::_sv_invalid);
             break;
         default:
-            insert_character_to_string(_impl->current_token_data, to_lower(*pos));
+            // A run of a tag name also ends at '/', which the next step appends
+            insert_name_run(_impl->current_token_data, pos, false);
     }
 }
 
-auto scrp::Tokenizer::after_doctype_name(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::after_doctype_name(input_iterator &pos, scrp::States &stateChange) -> void
 {
     static constexpr std::string_view _public { "public" };
     static constexpr std::string_view _system { "system" };
@@ -1534,29 +2779,32 @@ auto scrp::Tokenizer::after_doctype_name(sc_string::iterator &pos, scrp::States
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
             // ignore
             break;
         case '>':
-            emit_doctype_token(_impl->current_token_data);
+            emit_doctype_token(_impl->current_token_data.str());
             stateChange = States::Data;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_0, *pos);
-            if (_impl->extra_token_data_0.size() <= _public.size() && string_to_lower(_impl->extra_token_data_0) == _public.substr(0, _impl->extra_token_data_0.size()))
+            insert_source_character(_impl->extra_token_data_0, pos, *pos);
+            auto keyword = _impl->extra_token_data_0.str();
+            if (_impl->extra_token_data_0.size() <= _public.size() && string_to_lower(keyword) == _public.substr(0, _impl->extra_token_data_0.size()))
             {
-                if (string_to_lower(_impl->extra_token_data_0) == _public)
+                if (string_to_lower(keyword) == _public)
                 {
                     _impl->extra_token_data_0.clear();
                     _impl->extra_token_data_1.clear();
                     stateChange = States::AfterDOCTYPEPublicKeyword;
                 }
             }
-            else if (_impl->extra_token_data_0.size() <= _system.size() && string_to_lower(_impl->extra_token_data_0) == _system.substr(0, _impl->extra_token_data_0.size()))
+            else if (_impl->extra_token_data_0.size() <= _system.size() && string_to_lower(keyword) == _system.substr(0, _impl->extra_token_data_0.size()))
             {
-                if (string_to_lower(_impl->extra_token_data_0) == _system)
+                if (string_to_lower(keyword) == _system)
                 {
                     _impl->extra_token_data_0.clear();
                     _impl->extra_token_data_1.clear();
@@ -1573,7 +2821,7 @@ auto scrp::Tokenizer::after_doctype_name(sc_string::iterator &pos, scrp::States
     }
 }
 
-auto scrp::Tokenizer::after_doctype_public_keyword(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::after_doctype_public_keyword(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1581,6 +2829,8 @@ auto scrp::Tokenizer::after_doctype_public_keyword(sc_string::iterator &pos, scr
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1596,7 +2846,7 @@ auto scrp::Tokenizer::after_doctype_public_keyword(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::missing_doctype_public_identifier);
-            emit_doctype_token(_impl->current_token_data, true);
+            emit_doctype_token(_impl->current_token_data.str(), true);
             stateChange = States::Data;
             break;
         default:
@@ -1606,7 +2856,7 @@ auto scrp::Tokenizer::after_doctype_public_keyword(sc_string::iterator &pos, scr
     }
 }
 
-auto scrp::Tokenizer::before_doctype_public_identifier(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::before_doctype_public_identifier(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1614,6 +2864,8 @@ auto scrp::Tokenizer::before_doctype_public_identifier(sc_string::iterator &pos,
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1627,7 +2879,7 @@ auto scrp::Tokenizer::before_doctype_public_identifier(sc_string::iterator &pos,
             break;
         case '>':
             emit_error(parser_error_type::missing_doctype_public_identifier);
-            emit_doctype_token(_impl->current_token_data, true);
+            emit_doctype_token(_impl->current_token_data.str(), true);
             stateChange = States::Data;
             break;
         default:
@@ -1637,7 +2889,7 @@ auto scrp::Tokenizer::before_doctype_public_identifier(sc_string::iterator &pos,
     }
 }
 
-auto scrp::Tokenizer::doctype_public_identifier_dq(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype_public_identifier_dq(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1651,24 +2903,24 @@ auto scrp::Tokenizer::doctype_public_identifier_dq(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::abrupt_doctype_public_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), true);
             stateChange = States::Data;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_0, *pos);
+            insert_source_character(_impl->extra_token_data_0, pos, *pos);
     }
 
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::doctype_public_identifier_sq(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype_public_identifier_sq(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1682,25 +2934,25 @@ auto scrp::Tokenizer::doctype_public_identifier_sq(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::abrupt_doctype_public_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), true);
             stateChange = States::Data;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_0, *pos);
+            insert_source_character(_impl->extra_token_data_0, pos, *pos);
     }
 
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_doctype);
         if (stateChange != States::Data)
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::after_doctype_public_identifier(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::after_doctype_public_identifier(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1708,13 +2960,15 @@ auto scrp::Tokenizer::after_doctype_public_identifier(sc_string::iterator &pos,
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
             stateChange = States::BetweenDOCTYPEPublicAndSystemIdentifiers;
             break;
         case '>':
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
             stateChange = States::Data;
             break;
         case '\"':
@@ -1727,7 +2981,7 @@ auto scrp::Tokenizer::after_doctype_public_identifier(sc_string::iterator &pos,
             break;
         default:
             {
-                if (is_control_character(*pos))
+                if (is_char_control(*pos))
                     emit_error(parser_error_type::control_character_in_input_stream);
             }
             emit_error(parser_error_type::missing_quote_before_doctype_system_identifier);
@@ -1738,14 +2992,14 @@ auto scrp::Tokenizer::after_doctype_public_identifier(sc_string::iterator &pos,
     if (is_next_char_eof(pos) && stateChange != States::Data)
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::between_doctype_public_and_system_identifiers(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::between_doctype_public_and_system_identifiers(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1753,13 +3007,15 @@ auto scrp::Tokenizer::between_doctype_public_and_system_identifiers(sc_string::i
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
             // Ignore
             break;
         case '>':
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
             stateChange = States::Data;
             break;
         case '\"':
@@ -1777,14 +3033,14 @@ auto scrp::Tokenizer::between_doctype_public_and_system_identifiers(sc_string::i
     if (is_next_char_eof(pos) && stateChange != States::Data)
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str());
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::after_doctype_system_keyword(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::after_doctype_system_keyword(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1792,6 +3048,8 @@ auto scrp::Tokenizer::after_doctype_system_keyword(sc_string::iterator &pos, scr
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1807,7 +3065,7 @@ auto scrp::Tokenizer::after_doctype_system_keyword(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::missing_doctype_system_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
             stateChange = States::Data;
             break;
         default:
@@ -1817,7 +3075,7 @@ auto scrp::Tokenizer::after_doctype_system_keyword(sc_string::iterator &pos, scr
     }
 }
 
-auto scrp::Tokenizer::before_doctype_system_identifier(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::before_doctype_system_identifier(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1825,6 +3083,8 @@ auto scrp::Tokenizer::before_doctype_system_identifier(sc_string::iterator &pos,
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -1838,7 +3098,7 @@ auto scrp::Tokenizer::before_doctype_system_identifier(sc_string::iterator &pos,
             break;
         case '>':
             emit_error(parser_error_type::missing_doctype_system_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
             stateChange = States::Data;
             break;
         default:
@@ -1848,7 +3108,7 @@ auto scrp::Tokenizer::before_doctype_system_identifier(sc_string::iterator &pos,
     }
 }
 
-auto scrp::Tokenizer::doctype_system_identifier_dq(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype_system_identifier_dq(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1861,23 +3121,23 @@ auto scrp::Tokenizer::doctype_system_identifier_dq(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::abrupt_doctype_system_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
             stateChange = States::Data;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+            insert_source_character(_impl->extra_token_data_1, pos, *pos);
     }
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::doctype_system_identifier_sq(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::doctype_system_identifier_sq(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1890,23 +3150,23 @@ auto scrp::Tokenizer::doctype_system_identifier_sq(sc_string::iterator &pos, scr
             break;
         case '>':
             emit_error(parser_error_type::abrupt_doctype_system_identifier);
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
             stateChange = States::Data;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+            insert_source_character(_impl->extra_token_data_1, pos, *pos);
     }
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::after_doctype_system_identifier(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::after_doctype_system_identifier(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1914,13 +3174,15 @@ auto scrp::Tokenizer::after_doctype_system_identifier(sc_string::iterator &pos,
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
             // Ignore
             break;
         case '>':
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str());
             stateChange = States::Data;
             break;
         default:
@@ -1933,19 +3195,19 @@ auto scrp::Tokenizer::after_doctype_system_identifier(sc_string::iterator &pos,
     if (is_next_char_eof(pos) && stateChange != States::Data)
     {
         emit_error(parser_error_type::eof_in_doctype);
-        emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, true);
+        emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), true);
         emit_eof_token();
         stateChange = States::Data; // Prevent the call to handle_eof_error()
         return;
     }
 }
 
-auto scrp::Tokenizer::bogus_doctype(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::bogus_doctype(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
         case '>':
-            emit_doctype_token(_impl->current_token_data, _impl->extra_token_data_0, _impl->extra_token_data_1, _impl->quirk_flag);
+            emit_doctype_token(_impl->current_token_data.str(), _impl->extra_token_data_0.str(), _impl->extra_token_data_1.str(), _impl->quirk_flag);
             stateChange = States::Data;
             break;
         case 0:
@@ -1955,7 +3217,7 @@ auto scrp::Tokenizer::bogus_doctype(sc_string::iterator &pos, scrp::States &stat
     }
 }
 
-auto scrp::Tokenizer::cdata_section(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::cdata_section(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1963,18 +3225,18 @@ auto scrp::Tokenizer::cdata_section(sc_string::iterator &pos, scrp::States &stat
             stateChange = States::CDATASectionBracket;
             break;
         default:
-            insert_character_to_string(_impl->current_token_data, *pos);
+            insert_source_character(_impl->current_token_data, pos, *pos);
     }
 
     if (is_next_char_eof(pos))
     {
         emit_error(parser_error_type::eof_in_cdata);
-        emit_cdata_token(_impl->current_token_data);
+        emit_cdata_token(_impl->current_token_data.str());
         return;
     }
 }
 
-auto scrp::Tokenizer::cdata_section_bracket(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::cdata_section_bracket(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -1988,7 +3250,7 @@ auto scrp::Tokenizer::cdata_section_bracket(sc_string::iterator &pos, scrp::Stat
     }
 }
 
-auto scrp::Tokenizer::cdata_section_end(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::cdata_section_end(input_iterator &pos, scrp::States &stateChange) -> void
 {
     using namespace std::string_view_literals;
     switch (*pos)
@@ -1997,7 +3259,7 @@ auto scrp::Tokenizer::cdata_section_end(sc_string::iterator &pos, scrp::States &
             insert_character_to_string(_impl->current_token_data, ']');
             break;
         case '>':
-            emit_cdata_token(_impl->current_token_data);
+            emit_cdata_token(_impl->current_token_data.str());
             stateChange = States::Data;
             break;
         default:
@@ -2007,7 +3269,7 @@ auto scrp::Tokenizer::cdata_section_end(sc_string::iterator &pos, scrp::States &
     }
 }
 
-auto scrp::Tokenizer::end_tag_open(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::end_tag_open(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2034,14 +3296,14 @@ auto scrp::Tokenizer::end_tag_open(sc_string::iterator &pos, scrp::States &state
     {
         if (stateChange != States::Data)
         {
-            emit_character_token("<");
-            emit_character_token("/");
+            emit_characters("<");
+            emit_characters("/");
         }
         emit_eof_token();
     }
 }
 
-auto scrp::Tokenizer::tag_name(sc_string::iterator &pos, scrp::States &stateChange) -> void
+auto scrp::Tokenizer::tag_name(input_iterator &pos, scrp::States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2049,26 +3311,28 @@ auto scrp::Tokenizer::tag_name(sc_string::iterator &pos, scrp::States &stateChan
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
+            _impl->select_tag();
             stateChange = States::BeforeAttributeName;
             break;
         case '/':
+            _impl->select_tag();
             stateChange = States::SelfClosingStartTag;
             break;
         case '>':
-            emit_tag_token(_impl->current_token_data, _impl->attributes);
+            _impl->select_tag();
+            emit_current_tag_token();
             stateChange = States::Data;
             break;
         case 0:
             emit_error(parser_error_type::unexpected_null_character);
             insert_character_to_string(_impl->current_token_data, encoding::_sv_invalid);
         default:
-            {
-                const auto ch = to_lower(*pos);
-                insert_character_to_string(_impl->current_token_data, ch);
-            }
+            insert_name_run(_impl->current_token_data, pos, false);
     }
 
     if (is_next_char_eof(pos) && stateChange != States::Data)
@@ -2078,7 +3342,7 @@ auto scrp::Tokenizer::tag_name(sc_string::iterator &pos, scrp::States &stateChan
     }
 }
 
-auto scrp::Tokenizer::before_attribute_name(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::before_attribute_name(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2086,6 +3350,8 @@ auto scrp::Tokenizer::before_attribute_name(sc_string::iterator &pos, States &st
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2100,7 +3366,7 @@ auto scrp::Tokenizer::before_attribute_name(sc_string::iterator &pos, States &st
         case '=':
             emit_error(parser_error_type::unexpected_equals_sign_before_attribute_name);
             _impl->extra_token_data_0.clear();
-            insert_character_to_string(_impl->extra_token_data_0, *pos);
+            insert_source_character(_impl->extra_token_data_0, pos, *pos);
             stateChange = States::AttributeName;
             break;
         default:
@@ -2116,7 +3382,7 @@ auto scrp::Tokenizer::before_attribute_name(sc_string::iterator &pos, States &st
     }
 }
 
-auto scrp::Tokenizer::attribute_name(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::attribute_name(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2124,6 +3390,8 @@ auto scrp::Tokenizer::attribute_name(sc_string::iterator &pos, States &stateChan
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2149,8 +3417,10 @@ auto scrp::Tokenizer::attribute_name(sc_string::iterator &pos, States &stateChan
             emit_error(parser_error_type::unexpected_character_in_attribute_name);
             [[fallthrough]];
         default:
-            const auto ch = to_lower(*pos);
-            insert_character_to_string(_impl->extra_token_data_0, ch);
+            if (_impl->skip_tag)
+                skip_source_run(pos, scanner::class_attribute_name_end);
+            else
+                insert_name_run(_impl->extra_token_data_0, pos, true);
     }
 
     if (is_next_char_eof(pos))
@@ -2160,7 +3430,7 @@ auto scrp::Tokenizer::attribute_name(sc_string::iterator &pos, States &stateChan
     }
 }
 
-auto scrp::Tokenizer::after_attribute_name(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::after_attribute_name(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2168,6 +3438,8 @@ auto scrp::Tokenizer::after_attribute_name(sc_string::iterator &pos, States &sta
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2187,7 +3459,7 @@ auto scrp::Tokenizer::after_attribute_name(sc_string::iterator &pos, States &sta
                 _impl->extra_token_data_1.clear();
             }
 
-            emit_tag_token(_impl->current_token_data, _impl->attributes);
+            emit_current_tag_token();
             stateChange = States::Data;
             break;
         default:
@@ -2206,7 +3478,7 @@ auto scrp::Tokenizer::after_attribute_name(sc_string::iterator &pos, States &sta
     }
 }
 
-auto scrp::Tokenizer::before_attribute_value(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::before_attribute_value(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2214,6 +3486,8 @@ auto scrp::Tokenizer::before_attribute_value(sc_string::iterator &pos, States &s
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2235,7 +3509,7 @@ auto scrp::Tokenizer::before_attribute_value(sc_string::iterator &pos, States &s
                 _impl->extra_token_data_1.clear();
             }
 
-            emit_tag_token(_impl->current_token_data, _impl->attributes);
+            emit_current_tag_token();
             stateChange = States::Data;
             break;
         default:
@@ -2244,7 +3518,7 @@ auto scrp::Tokenizer::before_attribute_value(sc_string::iterator &pos, States &s
     }
 }
 
-auto scrp::Tokenizer::attribute_value_dq(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::attribute_value_dq(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2252,6 +3526,12 @@ auto scrp::Tokenizer::attribute_value_dq(sc_string::iterator &pos, States &state
             stateChange = States::AfterAttributeValueQuoted;
             break;
         case '&':
+            // The values of skipped tags are not decoded
+            if (_impl->skip_tag)
+            {
+                skip_source_run(pos, scanner::class_attribute_dq_end);
+                break;
+            }
             _impl->state.push(States::AttributeValueDQ);
             stateChange = States::CharacterReference;
             break;
@@ -2261,7 +3541,10 @@ auto scrp::Tokenizer::attribute_value_dq(sc_string::iterator &pos, States &state
             ;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+            if (_impl->skip_tag)
+                skip_source_run(pos, scanner::class_attribute_dq_end);
+            else
+                insert_source_run(_impl->extra_token_data_1, pos, scanner::class_attribute_dq_end);
     }
 
     if (is_next_char_eof(pos))
@@ -2271,7 +3554,7 @@ auto scrp::Tokenizer::attribute_value_dq(sc_string::iterator &pos, States &state
     }
 }
 
-auto scrp::Tokenizer::attribute_value_sq(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::attribute_value_sq(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2279,6 +3562,12 @@ auto scrp::Tokenizer::attribute_value_sq(sc_string::iterator &pos, States &state
             stateChange = States::AfterAttributeValueQuoted;
             break;
         case '&':
+            // The values of skipped tags are not decoded
+            if (_impl->skip_tag)
+            {
+                skip_source_run(pos, scanner::class_attribute_sq_end);
+                break;
+            }
             _impl->state.push(States::AttributeValueSQ);
             stateChange = States::CharacterReference;
             break;
@@ -2288,7 +3577,10 @@ auto scrp::Tokenizer::attribute_value_sq(sc_string::iterator &pos, States &state
             ;
             break;
         default:
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+            if (_impl->skip_tag)
+                skip_source_run(pos, scanner::class_attribute_sq_end);
+            else
+                insert_source_run(_impl->extra_token_data_1, pos, scanner::class_attribute_sq_end);
     }
 
     if (is_next_char_eof(pos))
@@ -2298,7 +3590,7 @@ auto scrp::Tokenizer::attribute_value_sq(sc_string::iterator &pos, States &state
     }
 }
 
-auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::attribute_value_unquoted(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2306,6 +3598,8 @@ auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2313,10 +3607,14 @@ auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States
             _impl->extra_token_data_0.clear();
             _impl->extra_token_data_1.clear();
             stateChange = States::BeforeAttributeName;
-            if (!_impl->state.empty() && _impl->state.top() != States::Data)
-                _impl->state.pop();
             break;
         case '&':
+            // The values of skipped tags are not decoded
+            if (_impl->skip_tag)
+            {
+                skip_source_run(pos, scanner::class_attribute_value_end);
+                break;
+            }
             _impl->state.push(States::AttributeValueUnquoted);
             stateChange = States::CharacterReference;
             break;
@@ -2324,9 +3622,7 @@ auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States
             insert_attribute(_impl->extra_token_data_0, _impl->extra_token_data_1);
             _impl->extra_token_data_0.clear();
             _impl->extra_token_data_1.clear();
-            emit_tag_token(_impl->current_token_data, _impl->attributes);
-            if (!_impl->state.empty() && _impl->state.top() != States::Data)
-                _impl->state.pop();
+            emit_current_tag_token();
             stateChange = States::Data;
             break;
         case 0:
@@ -2345,7 +3641,10 @@ auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States
             emit_error(parser_error_type::unexpected_character_in_unquoted_attribute_value);
             [[fallthrough]];
         default:
-            insert_character_to_string(_impl->extra_token_data_1, *pos);
+            if (_impl->skip_tag)
+                skip_source_run(pos, scanner::class_attribute_value_end);
+            else
+                insert_source_run(_impl->extra_token_data_1, pos, scanner::class_attribute_value_end);
     }
 
     if (is_next_char_eof(pos) && stateChange != States::Data)
@@ -2355,7 +3654,7 @@ auto scrp::Tokenizer::attribute_value_unquoted(sc_string::iterator &pos, States
     }
 }
 
-auto scrp::Tokenizer::after_attribute_value_quoted(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::after_attribute_value_quoted(input_iterator &pos, States &stateChange) -> void
 {
     insert_attribute(_impl->extra_token_data_0, _impl->extra_token_data_1);
     _impl->extra_token_data_0.clear();
@@ -2367,6 +3666,8 @@ auto scrp::Tokenizer::after_attribute_value_quoted(sc_string::iterator &pos, Sta
             [[fallthrough]];
         case 0x0A:
             [[fallthrough]];
+        case 0x0D:
+            [[fallthrough]];
         case 0x0C:
             [[fallthrough]];
         case 0x20:
@@ -2377,9 +3678,7 @@ auto scrp::Tokenizer::after_attribute_value_quoted(sc_string::iterator &pos, Sta
             break;
         case '>':
 
-            emit_tag_token(_impl->current_token_data, _impl->attributes);
-            if (!_impl->state.empty() && _impl->state.top() != States::Data)
-                _impl->state.pop();
+            emit_current_tag_token();
             stateChange = States::Data;
             break;
         default:
@@ -2395,7 +3694,7 @@ auto scrp::Tokenizer::after_attribute_value_quoted(sc_string::iterator &pos, Sta
     }
 }
 
-auto scrp::Tokenizer::self_closing_start_tag(sc_string::iterator &pos, States &stateChange) -> void
+auto scrp::Tokenizer::self_closing_start_tag(input_iterator &pos, States &stateChange) -> void
 {
     switch (*pos)
     {
@@ -2407,9 +3706,7 @@ auto scrp::Tokenizer::self_closing_start_tag(sc_string::iterator &pos, States &s
                 _impl->extra_token_data_1.clear();
             }
 
-            emit_tag_token(_impl->current_token_data, _impl->attributes, true);
-            if (!_impl->state.empty() && _impl->state.top() != States::Data)
-                _impl->state.pop();
+            emit_current_tag_token(true);
             stateChange = States::Data;
             break;
         default:
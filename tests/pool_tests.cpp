@@ -15,7 +15,9 @@
 #include <catch2/matchers/catch_matchers_string.hpp>
 #include <fmt/core.h>
 #include <iostream>
+#include <optional>
 #include <random>
+#include <thread>
 #include <vector>
 
 
@@ -556,3 +558,74 @@ TEST_CASE("Class constructor")
     CHECK(destructor_calls == 3);
 }
 
+
+TEST_CASE("Thread arena")
+{
+    using wbstring = std::basic_string<char, std::char_traits<char>, pool_iostream_reporter<char>>;
+    using arena    = pool::thread_arena<pool_iostream_reporter<char>>;
+
+    SECTION("Allocations of the arena and of the shared pools")
+    {
+        wbstring before("a string that is allocated in the shared pools");
+        const auto *shared = pool_iostream_reporter<char>::get_global_allocator();
+
+        {
+            arena local;
+            wbstring inside("a string that is allocated in the pools of the arena");
+            CHECK_FALSE(shared->owns(inside.data(), 64));
+            CHECK(inside == "a string that is allocated in the pools of the arena");
+
+            // Shared memory goes back to the shared pools
+            before = wbstring {};
+        }
+
+        wbstring after("a string that is allocated in the shared pools");
+        CHECK(shared->owns(after.data(), 64));
+    }
+
+    SECTION("Threads with arenas of their own")
+    {
+        std::vector<std::thread> threads;
+        std::vector<int> valid(4, 0);
+        for (std::size_t t = 0; t < valid.size(); ++t)
+        {
+            threads.emplace_back([&valid, t] {
+                arena local;
+                std::vector<wbstring, pool_iostream_reporter<wbstring>> strings;
+                for (std::size_t i = 0; i < 500; ++i)
+                    strings.emplace_back(fmt::format("thread {} string {} with some text to leave the small buffer", t, i));
+
+                valid[t] = 1;
+                for (std::size_t i = 0; i < strings.size(); ++i)
+                {
+                    if (std::string_view { strings[i] } != fmt::format("thread {} string {} with some text to leave the small buffer", t, i))
+                        valid[t] = 0;
+                }
+            });
+        }
+
+        for (auto &thread : threads)
+            thread.join();
+
+        CHECK(valid == std::vector<int>(4, 1));
+    }
+
+    SECTION("Allocators made in an arena outlive it")
+    {
+        wbstring before("a string that is allocated in the shared pools");
+        const auto *shared = pool_iostream_reporter<char>::get_global_allocator();
+
+        // The allocators of the thread took their references without locking; they are given back all the same
+        std::vector<std::optional<wbstring>> empty(4);
+        {
+            arena local;
+            for (auto &string : empty)
+                string.emplace();
+        }
+        empty.clear();
+
+        CHECK(pool_iostream_reporter<char>::get_global_allocator() == shared);
+        wbstring after("a string that is allocated in the shared pools");
+        CHECK(shared->owns(after.data(), 64));
+    }
+}
@@ -8,17 +8,33 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_string.hpp>
 
+#include <atoms.hpp>
+#include <batch_tokenizer.hpp>
 #include <crc64.hpp>
 #include <encoding.hpp>
 #include <encoding_character_reference.hpp>
+#include <mapped_file.hpp>
 
 #include <fmt/core.h>
 #include <parser.hpp>
 #include <parser_error.hpp>
+#include <scanner.hpp>
+#include <sink_tokenizer.hpp>
+#include <small_vector.hpp>
 #include <tokenizer.hpp>
 
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <limits>
+#include <map>
 #include <random>
 
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif /*__linux__*/
+
 TEST_CASE("Scrapper Tokenizer")
 {
     scrp::initialize();
@@ -317,10 +333,49 @@ TEST_CASE("DOCTYPE Test")
         REQUIRE(tok.tokens().size() == 1);
 
         CHECK_COMMENT(scrp::Tokenizer::comment_token_cast(tok.tokens()[0]), "DOC");
-        CHECK(tok.tokens()[1]->type == scrp::TokenType::EndOfFile);
         CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::incorrectly_opened_comment);
     }
 
+    SECTION("Truncated doctype start at the end of the input: <!DOC")
+    {
+        scrp::Tokenizer tok("<!DOC");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+
+        CHECK_COMMENT(scrp::Tokenizer::comment_token_cast(tok.tokens()[0]), "DOC");
+        CHECK_EOF(scrp::Tokenizer::eof_token_cast(tok.tokens()[1]));
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::incorrectly_opened_comment);
+    }
+
+    SECTION("Dashes after a partial doctype: <!d--x-->")
+    {
+        scrp::Tokenizer tok("<!d--x-->");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        REQUIRE(tok.tokens().size() == 1);
+
+        CHECK_COMMENT(scrp::Tokenizer::comment_token_cast(tok.tokens()[0]), "d--x--");
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::incorrectly_opened_comment);
+    }
+
+    SECTION("Mixed case doctype: <!DoCtYpE html>")
+    {
+        scrp::Tokenizer tok("<!DoCtYpE html>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        CHECK(tok.get_parse_errors().empty());
+        REQUIRE(!tok.tokens().empty());
+        CHECK(scrp::Tokenizer::doctype_token_cast(tok.tokens()[0])->name == "html");
+    }
+
     SECTION("Doctype in error: <!DOCTYPE foo>")
     {
         scrp::Tokenizer tok("<!DOCTYPE foo>");
@@ -1593,7 +1648,11 @@ TEST_CASE("HTML Comments")
 TEST_CASE("Tag tests")
 {
     auto CHECK_ATTRIBUTES = [&](scrp::TagToken *tok, scrp::sc_unordered_map<scrp::sc_string, scrp::sc_string> &&data) -> void {
-        CHECK(tok->attributes == data);
+        scrp::sc_unordered_map<scrp::sc_string, scrp::sc_string> attributes;
+        for (const auto &attr : tok->attributes)
+            attributes.emplace(attr.name, attr.value);
+        CHECK(attributes.size() == tok->attributes.size());
+        CHECK(attributes == data);
     };
 
     scrp::initialize();
@@ -2121,7 +2180,7 @@ TEST_CASE("Tag tests")
 
         CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "a", false);
         CHECK_ATTRIBUTES_SIZE(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), 1);
-        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), {{"(", ""}});
+        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), {{"(", ""}});
     }
 
     SECTION("<a ->")
@@ -2136,7 +2195,7 @@ TEST_CASE("Tag tests")
 
         CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "a", false);
         CHECK_ATTRIBUTES_SIZE(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), 1);
-        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), {{"-", ""}});
+        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), {{"-", ""}});
     }
 
     SECTION("<a .>")
@@ -2151,7 +2210,7 @@ TEST_CASE("Tag tests")
 
         CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "a", false);
         CHECK_ATTRIBUTES_SIZE(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), 1);
-        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), {{".", ""}});
+        CHECK_ATTRIBUTES(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), {{".", ""}});
     }
 
      SECTION("<a />")
@@ -2611,3 +2670,1850 @@ TEST_CASE("Tag tests")
 
 
 }
+
+TEST_CASE("Data state text runs")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    SECTION("Scanner matches the scalar scan")
+    {
+        std::mt19937 gen(1234);
+        std::uniform_int_distribution<int> rd(0, 255);
+
+        std::string buffer(4096, 'a');
+        for (auto &ch : buffer)
+        {
+            // Keep the delimiters rare, so long runs are also tested
+            const auto v = rd(gen);
+            ch           = v < 4 ? "<&\r\n"[v] : (v == 4 ? '\0' : static_cast<char>('a' + v % 26));
+        }
+
+        for (std::size_t start = 0; start < 128; ++start)
+        {
+            const char *first = buffer.data() + start;
+            const char *last  = buffer.data() + buffer.size();
+            while (first != last)
+            {
+                const auto *expected = scrp::scanner::find_data_delimiter_scalar(first, last);
+                const auto *found    = scrp::scanner::find_data_delimiter(first, last);
+                REQUIRE(found == expected);
+                first = found == last ? last : found + 1;
+            }
+        }
+    }
+
+    SECTION("Long text followed by a tag")
+    {
+        scrp::Tokenizer tok("This is a text run that is longer than any vector register<b>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().empty());
+        REQUIRE(tok.tokens().size() == 2);
+
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[0]), "This is a text run that is longer than any vector register");
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), "b", false);
+    }
+
+    SECTION("Text up to EOF")
+    {
+        scrp::Tokenizer tok("<b>text at the end of the document, longer than thirty two bytes");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().empty());
+        REQUIRE(tok.tokens().size() == 3);
+
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "b", false);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[1]), "text at the end of the document, longer than thirty two bytes");
+        CHECK_EOF(scrp::Tokenizer::eof_token_cast(tok.tokens()[2]));
+    }
+
+    SECTION("NUL inside a text run")
+    {
+        using namespace std::string_literals;
+        scrp::Tokenizer tok(scrp::sc_string { "ab\0cd<i>"s.data(), 8 });
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        REQUIRE(tok.tokens().size() == 2);
+
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[0]), "abcd");
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), "i", false);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::unexpected_null_character);
+    }
+
+    SECTION("Text and references build a single token")
+    {
+        for (const bool spans : { false, true })
+        {
+            scrp::Tokenizer tok("x &lt; y &amp;&amp; z & w</b>");
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+            if (spans)
+                tok.use_source_spans();
+
+            REQUIRE(tok.tokenize() == true);
+            REQUIRE(tok.get_parse_errors().empty());
+            REQUIRE(tok.tokens().size() == 2);
+
+            const auto *text = scrp::Tokenizer::character_token_cast(tok.tokens()[0]);
+            CHECK(text->view(tok.source()) == "x < y && z & w");
+            CHECK(text->span.empty());
+        }
+    }
+}
+
+TEST_CASE("Source spans")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    SECTION("Payloads equal to the source are not copied")
+    {
+        scrp::Tokenizer tok("<p class=\"intro\">Hello world<!--note--></p>");
+        tok.keep_tokens();
+        tok.use_source_spans();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().empty());
+        REQUIRE(tok.tokens().size() == 4);
+
+        const auto source = tok.source();
+
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(tag->tag_name.empty());
+        CHECK(tag->name_view(source) == "p");
+        REQUIRE(tag->attributes.size() == 1);
+        CHECK(tag->attributes[0].name.empty());
+        CHECK(tag->attributes[0].value.empty());
+        CHECK(tag->attributes[0].name_view(source) == "class");
+        CHECK(tag->attributes[0].value_view(source) == "intro");
+
+        auto *text = scrp::Tokenizer::character_token_cast(tok.tokens()[1]);
+        CHECK(text->code_point.empty());
+        CHECK(text->view(source) == "Hello world");
+
+        auto *comment = scrp::Tokenizer::comment_token_cast(tok.tokens()[2]);
+        CHECK(comment->comment.empty());
+        CHECK(comment->view(source) == "note");
+
+        auto *end_tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[3]);
+        CHECK(end_tag->type == scrp::TokenType::EndTag);
+        CHECK(end_tag->name_view(source) == "p");
+    }
+
+    SECTION("Payloads that differ from the source are owned")
+    {
+        scrp::Tokenizer tok("<DIV Id=a&amp;b>x&lt;y</DIV>");
+        tok.keep_tokens();
+        tok.use_source_spans();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 3);
+
+        const auto source = tok.source();
+
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(tag->name_span.empty());
+        CHECK(tag->tag_name == "div");
+        REQUIRE(tag->attributes.size() == 1);
+        CHECK(tag->attributes[0].name_view(source) == "id");
+        CHECK(tag->attributes[0].value_view(source) == "a&b");
+
+        auto *text = scrp::Tokenizer::character_token_cast(tok.tokens()[1]);
+        CHECK(text->span.empty());
+        CHECK(text->view(source) == "x<y");
+
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[2])->name_view(source) == "div");
+    }
+
+    SECTION("Duplicated attributes")
+    {
+        scrp::Tokenizer tok("<a b=1 b=2>");
+        tok.keep_tokens();
+        tok.use_source_spans();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::duplicate_attribute);
+
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        REQUIRE(tag->attributes.size() == 1);
+        CHECK(tag->attributes[0].value_view(tok.source()) == "1");
+    }
+}
+
+static auto describe_tokens(const scrp::Tokenizer &tok, const std::function<bool(scrp::Token *)> &filter = {}) -> std::string
+{
+    std::string description;
+    for (scrp::Token *token : tok.tokens())
+    {
+        if (filter && !filter(token))
+            continue;
+
+        switch (token->type)
+        {
+            case scrp::TokenType::Character:
+                description += fmt::format("C[{}]", scrp::Tokenizer::character_token_cast(token)->code_point);
+                break;
+            case scrp::TokenType::Comment:
+                description += fmt::format("M[{}]", scrp::Tokenizer::comment_token_cast(token)->comment);
+                break;
+            case scrp::TokenType::DOCTYPE:
+                description += fmt::format("D[{}]", scrp::Tokenizer::doctype_token_cast(token)->name);
+                break;
+            case scrp::TokenType::CDATA:
+                description += fmt::format("X[{}]", scrp::Tokenizer::cdata_token_cast(token)->cdata);
+                break;
+            case scrp::TokenType::Tag:
+            case scrp::TokenType::EndTag:
+                {
+                    const auto *tag = scrp::Tokenizer::tag_token_cast(token);
+                    description += fmt::format("{}[{}", token->type == scrp::TokenType::Tag ? "T" : "E", tag->tag_name);
+                    std::map<std::string, std::string> sorted;
+                    for (const auto &attr : tag->attributes)
+                        sorted.emplace(std::string { attr.name.data(), attr.name.size() }, std::string { attr.value.data(), attr.value.size() });
+                    for (const auto &[name, value] : sorted)
+                        description += fmt::format(" {}={}", name, value);
+                    description += "]";
+                }
+                break;
+            case scrp::TokenType::EndOfFile:
+                description += "EOF";
+                break;
+        }
+    }
+    return description;
+}
+
+TEST_CASE("Streaming input")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view document = "<!DOCTYPE html>\r\n<html lang=en><body class='a &amp; b'>"
+                                      "Some text &notin; &#x41; and more text that is long enough to span chunks\n"
+                                      "<!-- a comment --><p id=x>&lt;tag&gt;</p><![CDATA[x]]><br/></body></html>";
+
+    scrp::Tokenizer whole { scrp::sc_string { document.data(), document.size() } };
+    whole.keep_tokens();
+    whole.set_parser(&test_parser);
+    REQUIRE(whole.tokenize() == true);
+
+    const auto expected = describe_tokens(whole);
+
+    for (const std::size_t chunk_size : { 1, 2, 3, 7, 16, 64 })
+    {
+        DYNAMIC_SECTION("Chunks of " << chunk_size << " characters")
+        {
+            scrp::Tokenizer tok;
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+
+            for (std::size_t offset = 0; offset < document.size(); offset += chunk_size)
+                tok.feed(document.substr(offset, chunk_size));
+
+            REQUIRE(tok.finish() == true);
+
+            CHECK(describe_tokens(tok) == expected);
+            REQUIRE(tok.get_parse_errors().size() == whole.get_parse_errors().size());
+            for (std::size_t i = 0; i < whole.get_parse_errors().size(); ++i)
+            {
+                CHECK(tok.get_parse_errors()[i].type() == whole.get_parse_errors()[i].type());
+                CHECK(tok.get_parse_errors()[i].pos() == whole.get_parse_errors()[i].pos());
+            }
+        }
+    }
+
+    SECTION("Tokens are delivered before the input is complete")
+    {
+        scrp::Tokenizer tok;
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        // feed() holds back the 33 characters of the longest lookahead (a named character reference and the character after it),
+        // so the tags are followed by more than that. The comment is still open, which leaves the two tags as the only tokens
+        tok.feed("<html><body>");
+        tok.feed("<!--" + std::string(64, 'x'));
+        REQUIRE(tok.tokens().size() == 2);
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[0])->tag_name == "html");
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[1])->tag_name == "body");
+
+        REQUIRE(tok.finish() == true);
+        REQUIRE(tok.tokens().size() == 4);
+        CHECK(tok.tokens()[2]->type == scrp::TokenType::Comment);
+        CHECK(tok.tokens()[3]->type == scrp::TokenType::EndOfFile);
+    }
+
+    SECTION("No input")
+    {
+        scrp::Tokenizer tok;
+        tok.set_parser(&test_parser);
+        CHECK(tok.finish() == false);
+    }
+}
+
+TEST_CASE("Pulling tokens")
+{
+    scrp::initialize();
+
+    SECTION("Same tokens as the parser gets")
+    {
+        const std::string_view document = "<html><head><title>A &amp; B</title></head><!--c--><body>text</body></html>";
+
+        scrp::parser test_parser;
+        scrp::Tokenizer pushed { scrp::sc_string { document.data(), document.size() } };
+        pushed.keep_tokens();
+        pushed.set_parser(&test_parser);
+        REQUIRE(pushed.tokenize() == true);
+
+        scrp::Tokenizer pulled { scrp::sc_string { document.data(), document.size() } };
+        pulled.keep_tokens();
+
+        std::size_t count = 0;
+        while (auto *token = pulled.next())
+        {
+            REQUIRE(count < pushed.tokens().size());
+            CHECK(token == pulled.tokens()[count]);
+            CHECK(token->type == pushed.tokens()[count]->type);
+            ++count;
+        }
+
+        CHECK(count == pushed.tokens().size());
+        CHECK(describe_tokens(pulled) == describe_tokens(pushed));
+        CHECK(pulled.next() == nullptr);
+    }
+
+    SECTION("Stopping early")
+    {
+        scrp::Tokenizer tok("<head><title>Page</title><link rel=canonical href=/a></head><body></p a=b></body>");
+
+        auto *token = tok.next();
+        REQUIRE(token != nullptr);
+        CHECK(scrp::Tokenizer::tag_token_cast(token)->tag_name == "head");
+
+        token = tok.next();
+        REQUIRE(token != nullptr);
+        CHECK(scrp::Tokenizer::tag_token_cast(token)->tag_name == "title");
+
+        token = tok.next();
+        REQUIRE(token != nullptr);
+        REQUIRE(token->type == scrp::TokenType::Character);
+        CHECK(scrp::Tokenizer::character_token_cast(token)->code_point == "Page");
+
+        // The end tag with attributes at the end of the document has not been reached
+        CHECK(tok.get_parse_errors().empty());
+    }
+
+    SECTION("Trailing text")
+    {
+        scrp::Tokenizer tok("<b>text");
+
+        auto *token = tok.next();
+        REQUIRE(token != nullptr);
+        CHECK(token->type == scrp::TokenType::Tag);
+
+        token = tok.next();
+        REQUIRE(token != nullptr);
+        REQUIRE(token->type == scrp::TokenType::Character);
+        CHECK(scrp::Tokenizer::character_token_cast(token)->code_point == "text");
+
+        token = tok.next();
+        REQUIRE(token != nullptr);
+        CHECK(token->type == scrp::TokenType::EndOfFile);
+
+        CHECK(tok.next() == nullptr);
+    }
+
+    SECTION("Empty input")
+    {
+        scrp::Tokenizer tok("");
+        CHECK(tok.next() == nullptr);
+    }
+}
+
+TEST_CASE("Token records")
+{
+    scrp::initialize();
+
+    scrp::token_record tag { std::in_place_type<scrp::TagToken>, scrp::sc_string { "a" }, true };
+    CHECK(tag->type == scrp::TokenType::Tag);
+    REQUIRE(tag.as<scrp::TagToken>() != nullptr);
+    CHECK(tag.as<scrp::TagToken>()->self_closing);
+    CHECK(tag.as<scrp::CharacterToken>() == nullptr);
+    CHECK(scrp::Tokenizer::tag_token_cast(tag) == tag.as<scrp::TagToken>());
+
+    scrp::token_record eof { std::in_place_type<scrp::EOFToken> };
+    CHECK(eof->type == scrp::TokenType::EndOfFile);
+    CHECK(eof.as<scrp::TagToken>() == nullptr);
+
+    scrp::token_record doctype { std::in_place_type<scrp::DOCTYPEToken>, scrp::sc_string { "html" }, true };
+    CHECK(doctype->type == scrp::TokenType::DOCTYPE);
+    REQUIRE(doctype.as<scrp::DOCTYPEToken>() != nullptr);
+    CHECK(doctype.as<scrp::DOCTYPEToken>()->name == "html");
+    CHECK(doctype.as<scrp::DOCTYPEToken>()->force_quirks_flag);
+    CHECK(doctype.as<scrp::TagToken>() == nullptr);
+    CHECK(scrp::Tokenizer::doctype_token_cast(doctype) == doctype.as<scrp::DOCTYPEToken>());
+
+    // The DOCTYPE token is stored out of line; the records are as large as a tag token
+    static_assert(sizeof(scrp::token_record) < sizeof(scrp::DOCTYPEToken));
+    static_assert(sizeof(scrp::token_record) <= 96);
+
+    const auto &const_tag = tag;
+    static_assert(std::is_same_v<decltype(const_tag.as<scrp::TagToken>()), const scrp::TagToken *>);
+    CHECK(const_tag.as<scrp::TagToken>() == tag.as<scrp::TagToken>());
+
+    SECTION("Attributes are kept with the tokens")
+    {
+        // More attributes than a block of the store holds
+        std::string document;
+        for (int i = 0; i < 200; ++i)
+            document += fmt::format("<a href=/{} class=c{}>", i, i);
+
+        scrp::parser test_parser;
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 200);
+        for (std::size_t i = 0; i < tok.tokens().size(); ++i)
+        {
+            const auto *link = scrp::Tokenizer::tag_token_cast(tok.tokens()[i]);
+            REQUIRE(link->attributes.size() == 2);
+            CHECK(std::string_view { link->attributes[0].value } == fmt::format("/{}", i));
+            CHECK(std::string_view { link->attributes[1].value } == fmt::format("c{}", i));
+        }
+    }
+
+    SECTION("Hundreds of thousands of kept tokens")
+    {
+        // More than the pool can hold in one buffer of records
+        std::string document;
+        for (int i = 0; i < 100000; ++i)
+            document += "<a>x";
+
+        scrp::parser test_parser;
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 200001);
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[199998])->tag_name == "a");
+        CHECK(tok.tokens()[199999]->type == scrp::TokenType::Character);
+        CHECK(tok.tokens()[200000]->type == scrp::TokenType::EndOfFile);
+
+        tok.reset(scrp::sc_string { document.data(), document.size() });
+        CHECK(tok.try_tokenize() == scrp::tokenize_status::done);
+        CHECK(tok.tokens().size() == 200001);
+    }
+
+    SECTION("Tokens are stored contiguously")
+    {
+        scrp::parser test_parser;
+        scrp::Tokenizer tok("<a>b<!--c--><d>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 4);
+        for (std::size_t i = 0; i < tok.tokens().size(); ++i)
+        {
+            CHECK(&tok.tokens()[i] == tok.tokens().data() + i);
+            CHECK(tok.tokens()[i]->consumed);
+        }
+    }
+}
+
+TEST_CASE("Small vector")
+{
+    scrp::initialize();
+
+    using vector = scrp::small_vector<scrp::sc_string, 2, scrp::pool_allocator<scrp::sc_string>>;
+
+    vector inline_values;
+    inline_values.emplace_back("a");
+    inline_values.emplace_back("b");
+    CHECK(inline_values.is_inline());
+    CHECK(inline_values.size() == 2);
+
+    vector allocated = inline_values;
+    allocated.emplace_back("a string long enough to not fit in the small string buffer");
+    CHECK_FALSE(allocated.is_inline());
+    REQUIRE(allocated.size() == 3);
+    CHECK(allocated[0] == "a");
+    CHECK(allocated.back() == "a string long enough to not fit in the small string buffer");
+
+    SECTION("Moving inline elements")
+    {
+        vector moved { std::move(inline_values) };
+        CHECK(moved.is_inline());
+        CHECK(inline_values.empty());
+        REQUIRE(moved.size() == 2);
+        CHECK(moved[1] == "b");
+    }
+
+    SECTION("Moving allocated elements")
+    {
+        const auto *data = allocated.begin();
+
+        vector moved;
+        moved = std::move(allocated);
+        CHECK(moved.begin() == data);
+        CHECK(allocated.empty());
+        CHECK(allocated.is_inline());
+        REQUIRE(moved.size() == 3);
+        CHECK(moved[2] == "a string long enough to not fit in the small string buffer");
+
+        // Storage is reused after clearing
+        moved.clear();
+        moved.emplace_back("c");
+        CHECK(moved.begin() == data);
+    }
+
+    SECTION("Tags with many attributes")
+    {
+        scrp::parser test_parser;
+        scrp::Tokenizer tok("<a a=1 b=2 c=3 d=4 e=5 f=6 g=7 h=8 i=9 j=10 a=11>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::duplicate_attribute);
+
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        REQUIRE(tag->attributes.size() == 10);
+        CHECK(tag->attributes[0].value == "1");
+        CHECK(tag->attributes[9].name == "j");
+        CHECK(tag->attributes[9].value == "10");
+    }
+}
+
+TEST_CASE("Named character references")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    SECTION("Longest match")
+    {
+        auto match = scrp::encoding::match_reference("notin; x");
+        REQUIRE(match.reference != nullptr);
+        CHECK(match.length == 6);
+        CHECK(match.reference->data == "notin;");
+
+        match = scrp::encoding::match_reference("notit;");
+        REQUIRE(match.reference != nullptr);
+        CHECK(match.length == 3);
+        CHECK(match.reference->data == "not");
+
+        CHECK(scrp::encoding::match_reference("xyz;").reference == nullptr);
+        CHECK(scrp::encoding::match_reference("").reference == nullptr);
+    }
+
+    SECTION("The trie holds every reference of the table")
+    {
+        for (const auto &reference : scrp::encoding::chref_table)
+        {
+            const auto match = scrp::encoding::match_reference(reference.data);
+            REQUIRE(match.reference == &reference);
+            CHECK(match.length == reference.data.size());
+            CHECK(match.length <= scrp::encoding::max_reference_size);
+        }
+    }
+
+    SECTION("Text")
+    {
+        scrp::Tokenizer tok("a&b c&amp d&foo;<p>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[0]), "a&b c& d&foo;");
+        REQUIRE(tok.get_parse_errors().size() == 2);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::missing_semicolon_after_character_reference);
+        CHECK(tok.get_parse_errors()[1].type() == scrp::parser_error_type::unknown_named_character_reference);
+    }
+
+    SECTION("Ampersand at the end of the input")
+    {
+        scrp::Tokenizer tok("a&");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[0]), "a&");
+        CHECK_EOF(tok.tokens()[1]);
+    }
+
+    SECTION("Attribute values")
+    {
+        scrp::Tokenizer tok("<a href=\"?x=1&copy=2&amp;z&notit\" title=&lt>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        REQUIRE(tag->attributes.size() == 2);
+        CHECK(tag->attributes[0].value == "?x=1&copy=2&z&notit");
+        CHECK(tag->attributes[1].value == "<");
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::missing_semicolon_after_character_reference);
+    }
+
+    SECTION("Every reference returns to the state that consumed the ampersand")
+    {
+        std::string document;
+        for (int i = 0; i < 10; ++i)
+            document += "&#; &#x; ";
+        document += "<a title=\"&lt;\" id=&amp;>";
+
+        scrp::Tokenizer tok(scrp::sc_string { document.data(), document.size() });
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[1]);
+        REQUIRE(tag->tag_name == "a");
+        REQUIRE(tag->attributes.size() == 2);
+        CHECK(tag->attributes[0].value == "<");
+        CHECK(tag->attributes[1].value == "&");
+        CHECK(tok.get_parse_errors().size() == 20);
+    }
+}
+
+TEST_CASE("Line breaks")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    // Line 3 is empty: LF followed by a lone CR
+    const std::string_view document = "<p>\r\nline two\n\rline four <a =x>\n<b =y>";
+
+    SECTION("Error positions")
+    {
+        scrp::Tokenizer tok(scrp::sc_string { document.data(), document.size() });
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 2);
+
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::unexpected_equals_sign_before_attribute_name);
+        CHECK(tok.get_parse_errors()[0].pos() == 28);
+        CHECK(tok.get_parse_errors()[0].line() == 4);
+        CHECK(tok.get_parse_errors()[0].line_offset() == 13);
+
+        CHECK(tok.get_parse_errors()[1].pos() == 35);
+        CHECK(tok.get_parse_errors()[1].line() == 5);
+        CHECK(tok.get_parse_errors()[1].line_offset() == 3);
+    }
+
+    SECTION("Error positions while streaming")
+    {
+        scrp::Tokenizer tok;
+        tok.set_parser(&test_parser);
+
+        for (std::size_t i = 0; i < document.size(); i += 3)
+            tok.feed(document.substr(i, 3));
+        REQUIRE(tok.finish() == true);
+        REQUIRE(tok.get_parse_errors().size() == 2);
+
+        CHECK(tok.get_parse_errors()[0].line() == 4);
+        CHECK(tok.get_parse_errors()[0].line_offset() == 13);
+        CHECK(tok.get_parse_errors()[1].line() == 5);
+        CHECK(tok.get_parse_errors()[1].line_offset() == 3);
+    }
+
+    SECTION("Line breaks are text and separate attributes")
+    {
+        scrp::Tokenizer tok("a\nb<a\r\nhref=x\rc=d>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().empty());
+        REQUIRE(tok.tokens().size() == 2);
+
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[0]), "a\nb");
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), "a", false);
+        CHECK_ATTRIBUTES_SIZE(scrp::Tokenizer::tag_token_cast(tok.tokens()[1]), 2);
+    }
+
+    SECTION("Line breaks in comments and attribute values are not errors")
+    {
+        const std::string_view multiline = "<!-- a\n\n\nb --><a href=\"x\ny\" title='one\r\ntwo'><!DOCTYPE html PUBLIC \"-//a\nb\">";
+
+        for (const bool spans : { false, true })
+        {
+            scrp::Tokenizer tok(scrp::sc_string { multiline.data(), multiline.size() });
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+            if (spans)
+                tok.use_source_spans();
+
+            REQUIRE(tok.tokenize() == true);
+            CHECK(tok.error_count() == 0);
+            REQUIRE(tok.tokens().size() >= 3);
+
+            const auto source = tok.source();
+            CHECK(scrp::Tokenizer::comment_token_cast(tok.tokens()[0])->view(source) == " a\n\n\nb ");
+            const auto *link = scrp::Tokenizer::tag_token_cast(tok.tokens()[1]);
+            REQUIRE(link->attributes.size() == 2);
+            CHECK(link->attributes[0].value_view(source) == "x\ny");
+            CHECK(link->attributes[1].value_view(source) == "one\r\ntwo");
+            CHECK(scrp::Tokenizer::doctype_token_cast(tok.tokens()[2])->public_identifier_name == "-//a\nb");
+        }
+
+        // Other control characters still are
+        scrp::Tokenizer tok("<!-- a\x01b --><a href=\"x\x02y\">");
+        tok.set_parser(&test_parser);
+        (void)tok.tokenize();
+        CHECK(tok.error_count() == 2);
+    }
+}
+
+TEST_CASE("Reusing a tokenizer")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view first  = "<!DOCTYPE html><p class=a>first &amp; <b =x>";
+    const std::string_view second = "<html><body id=b>second</body>";
+
+    scrp::Tokenizer fresh(scrp::sc_string { second.data(), second.size() });
+    fresh.keep_tokens();
+    fresh.set_parser(&test_parser);
+    REQUIRE(fresh.tokenize() == true);
+
+    scrp::Tokenizer tok(scrp::sc_string { first.data(), first.size() });
+    tok.keep_tokens();
+    tok.set_parser(&test_parser);
+    REQUIRE(tok.tokenize() == true);
+    REQUIRE(!tok.get_parse_errors().empty());
+
+    SECTION("Same tokens as a new tokenizer")
+    {
+        tok.reset(scrp::sc_string { second.data(), second.size() });
+        CHECK(tok.tokens().empty());
+        CHECK(tok.get_parse_errors().empty());
+
+        REQUIRE(tok.tokenize() == true);
+        CHECK(tok.get_parse_errors().empty());
+        CHECK(describe_tokens(tok) == describe_tokens(fresh));
+    }
+
+    SECTION("Streaming after a reset")
+    {
+        tok.reset(scrp::sc_string {});
+        tok.feed(second.substr(0, 10));
+        tok.feed(second.substr(10));
+        REQUIRE(tok.finish() == true);
+        CHECK(describe_tokens(tok) == describe_tokens(fresh));
+    }
+
+    SECTION("Capacity limit")
+    {
+        std::string many;
+        for (int i = 0; i < 100; ++i)
+            many += "<a>";
+
+        tok.reset(scrp::sc_string { many.data(), many.size() });
+        REQUIRE(tok.tokenize() == true);
+        const auto grown = tok.tokens().capacity();
+        REQUIRE(grown >= 100);
+
+        tok.reset(scrp::sc_string { second.data(), second.size() });
+        CHECK(tok.tokens().capacity() == grown);
+
+        tok.reset(scrp::sc_string { second.data(), second.size() }, 64);
+        CHECK(tok.tokens().capacity() < 64);
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == describe_tokens(fresh));
+    }
+
+    SECTION("Reservations follow the input")
+    {
+        CHECK(fresh.tokens().capacity() < 64);
+
+        std::string many;
+        for (int i = 0; i < 100; ++i)
+            many += "<a>";
+
+        // Reserved from the number of tags before the first token, instead of grown to fit them
+        tok.reset(scrp::sc_string { many.data(), many.size() });
+        REQUIRE(tok.tokenize() == true);
+        CHECK(tok.tokens().size() == 100);
+        CHECK(tok.tokens().capacity() >= 150);
+
+        // Far more tokens than the records of the old fixed limit of 2048
+        std::string large;
+        for (int i = 0; i < 4000; ++i)
+            large += "<a>";
+
+        scrp::Tokenizer large_tok(scrp::sc_string { large.data(), large.size() });
+        large_tok.keep_tokens();
+        large_tok.set_parser(&test_parser);
+        REQUIRE(large_tok.tokenize() == true);
+        CHECK(large_tok.tokens().size() == 4000);
+        CHECK(large_tok.tokens().capacity() >= 6000);
+
+        tok.reset(scrp::sc_string { second.data(), second.size() }, 64);
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == describe_tokens(fresh));
+    }
+}
+
+TEST_CASE("Mapped files")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view document = "<!DOCTYPE html>\n<p class=a>Mapped &amp; tokenized<!--c--></p>";
+    const auto path                  = std::filesystem::temp_directory_path() / "wbscrp_mapped_file_test.html";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(document.data(), static_cast<std::streamsize>(document.size()));
+    }
+
+    scrp::Tokenizer whole(scrp::sc_string { document.data(), document.size() });
+    whole.keep_tokens();
+    whole.set_parser(&test_parser);
+    REQUIRE(whole.tokenize() == true);
+
+    SECTION("Same tokens as a copied input")
+    {
+        scrp::mapped_file file(path);
+        CHECK(file.view() == document);
+
+        scrp::Tokenizer tok(std::move(file));
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == describe_tokens(whole));
+    }
+
+    SECTION("Spans refer to the mapped memory")
+    {
+        scrp::Tokenizer tok { scrp::mapped_file(path) };
+        tok.keep_tokens();
+        tok.use_source_spans();
+        tok.set_parser(&test_parser);
+        REQUIRE(tok.tokenize() == true);
+        CHECK(tok.source() == document);
+
+        REQUIRE(tok.tokens().size() == whole.tokens().size());
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[2]);
+        CHECK_FALSE(tag->name_span.empty());
+        CHECK(tag->name_view(tok.source()) == "p");
+        CHECK(tag->attributes[0].value_view(tok.source()) == "a");
+    }
+
+    SECTION("Reset to a mapped file")
+    {
+        scrp::Tokenizer tok("<b>other</b>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        REQUIRE(tok.tokenize() == true);
+
+        tok.reset(scrp::mapped_file(path));
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == describe_tokens(whole));
+    }
+
+    SECTION("Missing file")
+    {
+        CHECK_THROWS_AS(scrp::mapped_file(path.string() + ".missing"), std::system_error);
+    }
+
+    std::filesystem::remove(path);
+
+    SECTION("Empty file")
+    {
+        const auto empty_path = std::filesystem::temp_directory_path() / "wbscrp_mapped_file_empty.html";
+        std::ofstream(empty_path).close();
+
+        scrp::mapped_file file(empty_path);
+        CHECK(file.empty());
+        std::filesystem::remove(empty_path);
+
+        scrp::Tokenizer tok(std::move(file));
+        tok.set_parser(&test_parser);
+        CHECK(tok.tokenize() == false);
+    }
+}
+
+TEST_CASE("Text elements")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    SECTION("Script contents are not markup")
+    {
+        scrp::Tokenizer tok(R"(<script>if (a<b && c</s) x="</scriptx>";</SCRIPT >y)");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        CHECK(tok.get_parse_errors().empty());
+        REQUIRE(tok.tokens().size() == 5);
+
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "script", false);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[1]), R"(if (a<b && c</s) x="</scriptx>";)");
+        CHECK_END_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[2]), "script");
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[3]), "y");
+        CHECK_EOF(scrp::Tokenizer::eof_token_cast(tok.tokens()[4]));
+    }
+
+    SECTION("RCDATA decodes character references")
+    {
+        scrp::Tokenizer tok("<title>A &amp; <b>B</b></title>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 3);
+
+        CHECK_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[0]), "title", false);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[1]), "A & <b>B</b>");
+        CHECK_END_TAG(scrp::Tokenizer::tag_token_cast(tok.tokens()[2]), "title");
+    }
+
+    SECTION("Unterminated contents run to the end of the input")
+    {
+        for (const auto *input : { "<style>p{}</style", "<plaintext>a</plaintext>b" })
+        {
+            scrp::Tokenizer tok(input);
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+
+            REQUIRE(tok.tokenize() == true);
+            REQUIRE(tok.tokens().size() == 3);
+            CHECK(tok.tokens()[1]->type == scrp::TokenType::Character);
+            CHECK_EOF(scrp::Tokenizer::eof_token_cast(tok.tokens()[2]));
+        }
+    }
+
+    SECTION("NUL characters are replaced")
+    {
+        const std::string input("<style>a\0b</style>", 18);
+        scrp::Tokenizer tok(scrp::sc_string { input.data(), input.size() });
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::unexpected_null_character);
+        CHECK(tok.get_parse_errors()[0].pos() == 8);
+        CHECK_CHARACTER(scrp::Tokenizer::character_token_cast(tok.tokens()[1]), "a\xEF\xBF\xBD" "b");
+    }
+
+    SECTION("Scanner matches the scalar search")
+    {
+        std::mt19937 gen(4321);
+        std::uniform_int_distribution<int> rd(0, 9);
+
+        constexpr std::string_view pieces[] = { "<", "/", "s", "S", "</scrip", "</script", "</script>", "</SCRIPT/", "x", "</scripts" };
+
+        std::string buffer;
+        while (buffer.size() < 4096)
+            buffer += pieces[rd(gen)];
+
+        const char *end = buffer.data() + buffer.size();
+        for (std::size_t start = 0; start < 64; ++start)
+        {
+            const char *first = buffer.data() + start;
+            while (first != end)
+            {
+                const auto *expected = scrp::scanner::find_end_tag_scalar(first, end, end, "script");
+                const auto *found    = scrp::scanner::find_end_tag(first, end, end, "script");
+                REQUIRE(found == expected);
+                first = found == end ? end : found + 1;
+            }
+        }
+    }
+
+    SECTION("Streaming")
+    {
+        const std::string_view document = "<p>a<script>var s = '<b>' + x </ b;</script><textarea>&lt;p&gt;</textarea><style>b{}</style>";
+
+        scrp::Tokenizer whole(scrp::sc_string { document.data(), document.size() });
+        whole.keep_tokens();
+        whole.set_parser(&test_parser);
+        REQUIRE(whole.tokenize() == true);
+
+        for (std::size_t chunk = 1; chunk < 8; ++chunk)
+        {
+            scrp::Tokenizer tok;
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+
+            for (std::size_t i = 0; i < document.size(); i += chunk)
+                tok.feed(document.substr(i, chunk));
+            REQUIRE(tok.finish() == true);
+            CHECK(describe_tokens(tok) == describe_tokens(whole));
+        }
+    }
+}
+
+namespace
+{
+    struct link_sink
+    {
+        auto on_tag(const scrp::TagToken &tag, std::string_view source) -> void
+        {
+            if (tag.name_view(source) != "a")
+                return;
+
+            for (const auto &attr : tag.attributes)
+            {
+                if (attr.name_view(source) == "href")
+                    links.emplace_back(attr.value_view(source));
+            }
+        }
+
+        std::vector<std::string> links;
+    };
+
+    struct text_sink
+    {
+        auto on_text(std::string_view value) -> void
+        {
+            text += value;
+        }
+
+        auto on_end_tag(const scrp::TagToken &tag, std::string_view source) -> void
+        {
+            end_tags += tag.name_view(source);
+        }
+
+        auto on_eof() -> void
+        {
+            ++eof;
+        }
+
+        std::string text;
+        std::string end_tags;
+        int eof { 0 };
+    };
+
+    // Keeps the tags of the head and stops once it is closed
+    struct head_sink
+    {
+        auto on_tag(const scrp::TagToken &tag, std::string_view source) -> void
+        {
+            tags += tag.name_view(source);
+            tags += ' ';
+        }
+
+        auto on_end_tag(const scrp::TagToken &tag, std::string_view source) -> void
+        {
+            head_closed = tag.name_view(source) == "head";
+        }
+
+        auto on_eof() -> void
+        {
+            ++eof;
+        }
+
+        [[nodiscard]] auto done() const -> bool
+        {
+            return head_closed;
+        }
+
+        std::string tags;
+        bool head_closed { false };
+        int eof { 0 };
+    };
+
+    // Gives the links of a document to storage of the caller
+    struct link_collector
+    {
+        auto on_tag(const scrp::TagToken &tag, std::string_view source) -> void
+        {
+            for (const auto &attr : tag.attributes)
+            {
+                if (attr.name_view(source) == "href")
+                    links->emplace_back(attr.value_view(source));
+            }
+        }
+
+        std::vector<std::string> *links;
+    };
+} // namespace
+
+TEST_CASE("Sink tokenizer")
+{
+    scrp::initialize();
+
+    static_assert(scrp::token_sink<link_sink>);
+    static_assert(!scrp::token_sink<std::string>);
+
+    const std::string_view document = R"(<p>Go <a href="/one">one</a> or <A class=x HREF='/two'>two</A><!--<a href=no>--></p>)";
+
+    SECTION("Only the handlers of the sink are called")
+    {
+        link_sink sink;
+        scrp::sink_tokenizer tok(sink);
+
+        REQUIRE(tok.tokenize(scrp::sc_string { document.data(), document.size() }) == true);
+        CHECK(sink.links == std::vector<std::string> { "/one", "/two" });
+    }
+
+    SECTION("Text, end tags and the end of the input")
+    {
+        text_sink sink;
+        scrp::sink_tokenizer tok(sink);
+        tok.tokenizer().use_source_spans();
+
+        REQUIRE(tok.tokenize(scrp::sc_string { document.data(), document.size() }) == true);
+        CHECK(sink.text == "Go one or two");
+        CHECK(sink.end_tags == "aap");
+        CHECK(sink.eof == 1);
+    }
+
+    SECTION("Reuse")
+    {
+        link_sink sink;
+        scrp::sink_tokenizer tok(sink);
+
+        REQUIRE(tok.tokenize(scrp::sc_string { document.data(), document.size() }) == true);
+        REQUIRE(tok.tokenize("<a href=three>") == true);
+        CHECK(tok.tokenize(scrp::sc_string {}) == false);
+        CHECK(sink.links == std::vector<std::string> { "/one", "/two", "three" });
+    }
+}
+
+TEST_CASE("Atoms")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    static_assert(scrp::atom_of("a") != scrp::no_atom);
+    static_assert(scrp::atom_name(scrp::atom_of("href")) == "href");
+
+    SECTION("Every name has its own atom")
+    {
+        for (scrp::atom_id atom = 1; atom < scrp::atoms::names.size(); ++atom)
+        {
+            REQUIRE(scrp::atom_of(scrp::atoms::names[atom]) == atom);
+            CHECK(scrp::atom_name(atom) == scrp::atoms::names[atom]);
+        }
+
+        CHECK(scrp::atom_of("") == scrp::no_atom);
+        CHECK(scrp::atom_of("DIV") == scrp::no_atom);
+        CHECK(scrp::atom_of("my-element") == scrp::no_atom);
+        CHECK(scrp::atom_of("hrefx") == scrp::no_atom);
+        CHECK(scrp::atom_name(scrp::no_atom).empty());
+    }
+
+    SECTION("Tags and attributes")
+    {
+        scrp::Tokenizer tok(R"(<DIV Class=x data-id=1 HREF=y><my-element></div>)");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 3);
+
+        auto *div = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(div->atom == scrp::atom_of("div"));
+        REQUIRE(div->attributes.size() == 3);
+        CHECK(div->attributes[0].atom == scrp::atom_of("class"));
+        CHECK(div->attributes[1].atom == scrp::no_atom);
+        CHECK(div->attributes[2].atom == scrp::atom_of("href"));
+
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[1])->atom == scrp::no_atom);
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[2])->atom == scrp::atom_of("div"));
+    }
+
+    SECTION("Source spans")
+    {
+        scrp::Tokenizer tok(R"(<td rowspan=2>)");
+        tok.use_source_spans();
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        auto *td = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(td->atom == scrp::atom_of("td"));
+        REQUIRE(td->attributes.size() == 1);
+        CHECK(td->attributes[0].atom == scrp::atom_of("rowspan"));
+    }
+}
+
+TEST_CASE("Character classes")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    SECTION("Every byte")
+    {
+        for (int value = -128; value < 128; ++value)
+        {
+            const auto ch = static_cast<scrp::char_type>(value);
+            const bool lower = ch >= 'a' && ch <= 'z';
+            const bool upper = ch >= 'A' && ch <= 'Z';
+            const bool digit = ch >= '0' && ch <= '9';
+
+            CHECK(scrp::scanner::has_class(ch, scrp::scanner::class_alpha) == (lower || upper));
+            CHECK(scrp::scanner::has_class(ch, scrp::scanner::class_alphanumeric) == (lower || upper || digit));
+            CHECK(scrp::scanner::has_class(ch, scrp::scanner::class_hex_digit) == (digit || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F')));
+            CHECK(scrp::scanner::has_class(ch, scrp::scanner::class_control) == ((value >= 0 && value <= 0x1F) || value == 0x7F));
+            CHECK(scrp::scanner::has_class(ch, scrp::scanner::class_stream_control) == (scrp::scanner::has_class(ch, scrp::scanner::class_control) && !scrp::scanner::has_class(ch, scrp::scanner::class_whitespace)));
+            CHECK(scrp::scanner::to_lower(ch) == (upper ? static_cast<scrp::char_type>(ch - 'A' + 'a') : ch));
+        }
+    }
+
+    SECTION("Runs of names and values")
+    {
+        scrp::Tokenizer tok("<sVg viewBox='0 0 10 10' data-Long-Name=\"x&lt;y\" c=a`b><!-- a <b> c -->");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+
+        auto *svg = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(svg->tag_name == "svg");
+        REQUIRE(svg->attributes.size() == 3);
+        CHECK(svg->attributes[0].name == "viewbox");
+        CHECK(svg->attributes[0].value == "0 0 10 10");
+        CHECK(svg->attributes[1].name == "data-long-name");
+        CHECK(svg->attributes[1].value == "x<y");
+        CHECK(svg->attributes[2].value == "a`b");
+        CHECK_COMMENT(scrp::Tokenizer::comment_token_cast(tok.tokens()[1]), " a <b> c ");
+
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::unexpected_character_in_unquoted_attribute_value);
+    }
+
+    SECTION("Source spans keep the runs without upper case letters")
+    {
+        const std::string_view document = "<span title=\"a long title\" Data-X=1>";
+
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.use_source_spans();
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        auto *span = scrp::Tokenizer::tag_token_cast(tok.tokens()[0]);
+        CHECK(span->tag_name.empty());
+        CHECK(span->name_view(tok.source()) == "span");
+        REQUIRE(span->attributes.size() == 2);
+        CHECK(span->attributes[0].name.empty());
+        CHECK(span->attributes[0].value.empty());
+        CHECK(span->attributes[0].value_view(tok.source()) == "a long title");
+        CHECK(span->attributes[1].name == "data-x");
+    }
+
+    SECTION("Control characters in a run")
+    {
+        scrp::Tokenizer tok("<a title=\"one\x01two\">");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        CHECK(scrp::Tokenizer::tag_token_cast(tok.tokens()[0])->attributes[0].value == "one\x01two");
+        REQUIRE(tok.get_parse_errors().size() == 1);
+        CHECK(tok.get_parse_errors()[0].type() == scrp::parser_error_type::control_character_in_input_stream);
+    }
+}
+
+TEST_CASE("Name runs")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    std::mt19937 gen(4321);
+    std::uniform_int_distribution<int> rd(0, 255);
+
+    // Every byte value, with the letters more common so long runs are also tested
+    std::string buffer(4096, 'a');
+    for (auto &ch : buffer)
+    {
+        const auto v = rd(gen);
+        ch           = v < 160 ? static_cast<char>((v % 2 == 0 ? 'a' : 'A') + v % 26) : static_cast<char>(rd(gen));
+    }
+
+    SECTION("Scanner matches the scalar scan")
+    {
+        for (const bool attribute_name : { false, true })
+        {
+            for (std::size_t start = 0; start < 64; ++start)
+            {
+                const char *first = buffer.data() + start;
+                const char *last  = buffer.data() + buffer.size();
+                while (first != last)
+                {
+                    const auto *expected = scrp::scanner::find_name_end_scalar(first, last, attribute_name);
+                    const auto *found    = scrp::scanner::find_name_end(first, last, attribute_name);
+                    REQUIRE(found == expected);
+                    first = found == last ? last : found + 1;
+                }
+            }
+        }
+    }
+
+    SECTION("Lower case copies match the scalar copy")
+    {
+        for (std::size_t start = 0; start < 64; ++start)
+        {
+            std::string expected(buffer.size() - start, '\0');
+            std::string found(buffer.size() - start, '\0');
+
+            scrp::scanner::copy_lower_scalar(buffer.data() + start, buffer.data() + buffer.size(), expected.data());
+            REQUIRE(scrp::scanner::copy_lower(buffer.data() + start, buffer.data() + buffer.size(), found.data()) == found.data() + found.size());
+            REQUIRE(found == expected);
+        }
+    }
+
+    SECTION("Long names")
+    {
+        scrp::Tokenizer tok("<!DOCTYPE HTML-WITH-A-NAME-LONGER-THAN-THIRTY-TWO><My-Custom-Element-With-A-Long-Name Data-Attribute-With-A-Long-Name=1 xmlns:xlink/>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        REQUIRE(tok.tokenize() == true);
+        REQUIRE(tok.tokens().size() == 2);
+        CHECK(scrp::Tokenizer::doctype_token_cast(tok.tokens()[0])->name == "html-with-a-name-longer-than-thirty-two");
+
+        auto *tag = scrp::Tokenizer::tag_token_cast(tok.tokens()[1]);
+        CHECK(tag->tag_name == "my-custom-element-with-a-long-name");
+        CHECK(tag->self_closing);
+        REQUIRE(tag->attributes.size() == 2);
+        CHECK(tag->attributes[0].name == "data-attribute-with-a-long-name");
+        CHECK(tag->attributes[1].name == "xmlns:xlink");
+    }
+}
+
+TEST_CASE("Parallel tokenization")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    // Lines that start with a tag are split points; the script, the comment, the attribute value and the textarea hold
+    // some that are not at a data boundary, so the guess for those segments is wrong. The repeated attribute is an error
+    // of every segment
+    std::string document = "<!DOCTYPE html>\n<html><body>\n";
+    for (int i = 0; i < 40; ++i)
+    {
+        document += fmt::format("<tr class=row><td>Item {} &amp; more</td>\n<td data-x='a\n<b>' data-x=y>x</td></tr>\n", i);
+        if (i % 5 == 0)
+            document += "<script>\nif (a\n<b) {}\n</script>\n<!-- c\n<p> -->\n<textarea>\n<p>\n</textarea>\n";
+    }
+    document += "</body></html>";
+
+    const auto compare = [&](bool spans, std::size_t threads, std::size_t segment_size) {
+        scrp::Tokenizer whole { scrp::sc_string { document.data(), document.size() } };
+        whole.keep_tokens();
+        whole.set_parser(&test_parser);
+        if (spans)
+            whole.use_source_spans();
+        const auto whole_result = whole.tokenize();
+
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        if (spans)
+            tok.use_source_spans();
+        CHECK(tok.tokenize_parallel(threads, segment_size) == whole_result);
+
+        CHECK(describe_tokens(tok) == describe_tokens(whole));
+        REQUIRE(tok.get_parse_errors().size() == whole.get_parse_errors().size());
+        for (std::size_t i = 0; i < whole.get_parse_errors().size(); ++i)
+        {
+            CHECK(tok.get_parse_errors()[i].type() == whole.get_parse_errors()[i].type());
+            CHECK(tok.get_parse_errors()[i].pos() == whole.get_parse_errors()[i].pos());
+            CHECK(tok.get_parse_errors()[i].line() == whole.get_parse_errors()[i].line());
+        }
+    };
+
+    SECTION("Same tokens and errors as a single thread")
+    {
+        for (const bool spans : { false, true })
+        {
+            for (const std::size_t threads : { 2, 3, 8 })
+            {
+                for (const std::size_t segment_size : { 1, 64, 700 })
+                    compare(spans, threads, segment_size);
+            }
+        }
+    }
+
+    SECTION("Inputs of one segment are tokenized in the calling thread")
+    {
+        compare(false, 4, document.size());
+        compare(true, 1, 64);
+    }
+}
+
+TEST_CASE("Batch tokenization")
+{
+    scrp::initialize();
+
+    // Document i has i % 5 links; every third one also has an end tag with attributes, which is a parse error
+    std::vector<std::string> storage;
+    for (std::size_t i = 0; i < 40; ++i)
+    {
+        std::string document = fmt::format("<p>Document {}</p>\n", i);
+        for (std::size_t link = 0; link < i % 5; ++link)
+            document += fmt::format("<a class=x HREF='/{}/{}'>link</a>\n", i, link);
+        if (i % 3 == 0)
+            document += "</p class=y>";
+        storage.push_back(i == 7 ? std::string {} : document);
+    }
+    const std::vector<std::string_view> documents(storage.begin(), storage.end());
+
+    for (const bool arenas : { true, false })
+    {
+        for (const std::size_t threads : { 1, 3, 8 })
+        {
+            DYNAMIC_SECTION("Threads " << threads << (arenas ? " with arenas" : " with the shared pools"))
+            {
+                std::vector<std::vector<std::string>> links(documents.size());
+
+                const auto result = scrp::batch_tokenize(
+                    documents, [&](std::size_t index) { return link_collector { &links[index] }; },
+                    { .threads = threads, .thread_arenas = arenas });
+
+                REQUIRE(result.documents.size() == documents.size());
+                CHECK(result.stats.workers == threads);
+                CHECK(result.stats.documents == documents.size() - 1);
+                CHECK(result.stats.failed == 0);
+
+                std::size_t errors = 0;
+                for (std::size_t i = 0; i < documents.size(); ++i)
+                {
+                    const auto &document = result.documents[i];
+                    CHECK(document.tokenized == (i != 7));
+                    CHECK(document.worker < threads);
+                    CHECK_FALSE(document.exception);
+
+                    std::vector<std::string> expected;
+                    for (std::size_t link = 0; i != 7 && link < i % 5; ++link)
+                        expected.push_back(fmt::format("/{}/{}", i, link));
+                    CHECK(links[i] == expected);
+
+                    const bool error = i % 3 == 0 && i != 7;
+                    REQUIRE(document.errors.size() == (error ? 1 : 0));
+                    if (error)
+                        CHECK(document.errors[0].type() == scrp::parser_error_type::end_tag_with_attributes);
+                    errors += document.errors.size();
+                }
+                CHECK(result.stats.errors == errors);
+            }
+        }
+    }
+
+    SECTION("Exceptions are given per document")
+    {
+        std::vector<std::vector<std::string>> links(documents.size());
+
+        const auto result = scrp::batch_tokenize(
+            documents, [&](std::size_t index) {
+                if (index == 4)
+                    throw std::runtime_error("no sink");
+                return link_collector { &links[index] };
+            },
+            { .threads = 2 });
+
+        CHECK(result.stats.failed == 1);
+        CHECK_FALSE(result.documents[4].tokenized);
+        CHECK(result.documents[4].errors.empty());
+        CHECK_THROWS_AS(std::rethrow_exception(result.documents[4].exception), std::runtime_error);
+        CHECK(links[4].empty());
+        CHECK(links[8] == std::vector<std::string> { "/8/0", "/8/1", "/8/2" });
+    }
+}
+
+TEST_CASE("Tag interest")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view document = "<!DOCTYPE html><html><head><meta charset=utf-8><LINK REL=canonical href='/page?a=1&amp;b=2'>"
+                                      "<title>A <a> in the title</title><script>if (a < b) { x = '<a href=no>'; }</script></head>"
+                                      "<body class=\"main &amp; wide\" data-x=1><div id=d title='&lt;&gt;'>Text <b>bold</b> "
+                                      "<a href=\"/one\" class=link>one</a><my-widget kind=x>w</my-widget><img src=x.png alt=\"&quot;\"/>"
+                                      "<textarea><a href=no></textarea></div><A HREF=/two>two</A></body></html>";
+
+    const auto interest    = std::array<std::string_view, 4> { "a", "LINK", "meta", "my-widget" };
+    const auto wanted_name = [](std::string_view name) { return name == "a" || name == "link" || name == "meta" || name == "my-widget"; };
+    const auto wanted      = [&](scrp::Token *token) {
+        return (token->type != scrp::TokenType::Tag && token->type != scrp::TokenType::EndTag)
+            || wanted_name(scrp::Tokenizer::tag_token_cast(token)->tag_name);
+    };
+
+    for (const bool spans : { false, true })
+    {
+        DYNAMIC_SECTION((spans ? "Source spans" : "Owned strings"))
+        {
+            scrp::Tokenizer whole { scrp::sc_string { document.data(), document.size() } };
+            whole.keep_tokens();
+            whole.set_parser(&test_parser);
+            REQUIRE(whole.tokenize() == true);
+
+            scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+            tok.set_tag_interest(interest);
+            if (spans)
+                tok.use_source_spans();
+            REQUIRE(tok.tokenize() == true);
+
+            // describe_tokens() reads the owned strings; with spans, the same set with owned strings gives as many tokens
+            if (spans)
+            {
+                scrp::Tokenizer owned { scrp::sc_string { document.data(), document.size() } };
+                owned.keep_tokens();
+                owned.set_parser(&test_parser);
+                owned.set_tag_interest(interest);
+                REQUIRE(owned.tokenize() == true);
+                CHECK(owned.tokens().size() == tok.tokens().size());
+            }
+            else
+                CHECK(describe_tokens(tok) == describe_tokens(whole, wanted));
+
+            std::size_t tags = 0;
+            for (scrp::Token *token : tok.tokens())
+            {
+                if (token->type != scrp::TokenType::Tag && token->type != scrp::TokenType::EndTag)
+                    continue;
+                ++tags;
+                CHECK(wanted_name(scrp::Tokenizer::tag_token_cast(token)->name_view(tok.source())));
+            }
+            CHECK(tags == 8);
+        }
+    }
+
+    SECTION("Attributes of the tags that are given")
+    {
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        tok.set_tag_interest({ "link" });
+        REQUIRE(tok.tokenize() == true);
+
+        REQUIRE(tok.tokens().size() > 1);
+        const auto *link = scrp::Tokenizer::tag_token_cast(tok.tokens()[1]);
+        REQUIRE(link->tag_name == "link");
+        REQUIRE(link->attributes.size() == 2);
+        CHECK(link->attributes[0].name == "rel");
+        CHECK(link->attributes[0].value == "canonical");
+        CHECK(link->attributes[1].value == "/page?a=1&b=2");
+    }
+
+    SECTION("Errors of skipped attributes are not reported")
+    {
+        scrp::Tokenizer tok("<p id=1 id=2><a id=1 id=2></p x=1>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        tok.set_tag_interest({ "a" });
+        CHECK(tok.tokenize() == true);
+
+        const auto errors = tok.get_parse_errors();
+        REQUIRE(errors.size() == 1);
+        CHECK(errors[0].type() == scrp::parser_error_type::duplicate_attribute);
+        CHECK(errors[0].pos() > 13);
+    }
+
+    SECTION("An empty set gives every tag")
+    {
+        scrp::Tokenizer tok("<p><a></a></p>");
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        tok.set_tag_interest({ "a" });
+        tok.set_tag_interest({});
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == "T[p]T[a]E[a]E[p]");
+    }
+}
+
+TEST_CASE("Early termination")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view document = "<html><head><title>Page</title><meta charset=utf-8><link rel=canonical href=/a></head>"
+                                      "<body><p id=1 id=2>text</p x=1><div></body></html>";
+
+    static_assert(scrp::sink_can_stop<head_sink>);
+    static_assert(!scrp::sink_can_stop<link_sink>);
+
+    SECTION("A sink stops the tokenizer")
+    {
+        head_sink sink;
+        scrp::sink_tokenizer tok(sink);
+
+        REQUIRE(tok.tokenize(scrp::sc_string { document.data(), document.size() }) == true);
+        CHECK(sink.tags == "html head title meta link ");
+        CHECK(sink.eof == 0);
+        CHECK(tok.tokenizer().stopped());
+        CHECK(tok.tokenizer().get_parse_errors().empty());
+
+        // The next input starts over
+        head_sink next;
+        tok.set_sink(next);
+        REQUIRE(tok.tokenize_view("<p></p>") == true);
+        CHECK(next.tags == "p ");
+        CHECK(next.eof == 1);
+        CHECK_FALSE(tok.tokenizer().stopped());
+    }
+
+    SECTION("The caller of next() stops the tokenizer")
+    {
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+
+        while (auto *token = tok.next())
+        {
+            if (token->type == scrp::TokenType::EndTag && scrp::Tokenizer::tag_token_cast(token)->tag_name == "head")
+                tok.stop();
+        }
+
+        CHECK(tok.stopped());
+        CHECK(tok.next() == nullptr);
+        CHECK(describe_tokens(tok) == "T[html]T[head]T[title]C[Page]E[title]T[meta charset=utf-8]T[link href=/a rel=canonical]E[head]");
+        CHECK(tok.get_parse_errors().empty());
+    }
+
+    SECTION("Input after stop() is ignored")
+    {
+        scrp::Tokenizer tok;
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        const auto head = document.find("<body>");
+        tok.feed(document.substr(0, head));
+        tok.stop();
+        tok.feed(document.substr(head));
+        CHECK(tok.finish() == true);
+
+        // feed() holds back the end of the head for the states that look ahead, the tokens given are a part of it
+        const auto description = describe_tokens(tok);
+        CHECK(tok.stopped());
+        CHECK_FALSE(description.empty());
+        CHECK(description.starts_with("T[html]T[head]"));
+        CHECK(description.find("body") == std::string::npos);
+        CHECK(tok.get_parse_errors().empty());
+
+        tok.reset(scrp::sc_string { "<p></p>" });
+        CHECK_FALSE(tok.stopped());
+        REQUIRE(tok.tokenize() == true);
+        CHECK(describe_tokens(tok) == "T[p]E[p]");
+    }
+}
+
+TEST_CASE("Tokenizing without exceptions")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    const std::string_view document = "<ul><li>one<li>two<li>three</ul>";
+
+    SECTION("Same tokens as tokenize()")
+    {
+        scrp::Tokenizer whole { scrp::sc_string { document.data(), document.size() } };
+        whole.keep_tokens();
+        whole.set_parser(&test_parser);
+        REQUIRE(whole.tokenize() == true);
+
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        CHECK(tok.try_tokenize() == scrp::tokenize_status::done);
+        CHECK(describe_tokens(tok) == describe_tokens(whole));
+        CHECK_FALSE(tok.stopped());
+
+        scrp::Tokenizer budgeted { scrp::sc_string { document.data(), document.size() } };
+        budgeted.keep_tokens();
+        budgeted.set_parser(&test_parser);
+        const auto reserved = budgeted.tokens().capacity();
+        CHECK(budgeted.try_tokenize(whole.tokens().size()) == scrp::tokenize_status::done);
+        CHECK(describe_tokens(budgeted) == describe_tokens(whole));
+        CHECK(budgeted.tokens().capacity() == std::max(reserved, whole.tokens().size()));
+    }
+
+    SECTION("No input")
+    {
+        scrp::Tokenizer tok;
+        CHECK(tok.try_tokenize() == scrp::tokenize_status::empty);
+    }
+
+    SECTION("The kept tokens do not grow beyond the budget")
+    {
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+        const auto reserved = tok.tokens().capacity();
+
+        CHECK(tok.try_tokenize(4) == scrp::tokenize_status::over_budget);
+        CHECK(tok.stopped());
+        CHECK(tok.tokens().capacity() == std::max<std::size_t>(reserved, 4));
+        CHECK(describe_tokens(tok) == "T[ul]T[li]C[one]T[li]");
+
+        tok.reset(scrp::sc_string { document.data(), document.size() });
+        CHECK(tok.try_tokenize() == scrp::tokenize_status::done);
+    }
+
+    SECTION("Neither do the errors")
+    {
+        scrp::Tokenizer tok("<p a=1 a=2 a=3 a=4></p x=1>");
+        tok.set_parser(&test_parser);
+
+        CHECK(tok.try_tokenize(2) == scrp::tokenize_status::over_budget);
+        const auto errors = tok.get_parse_errors();
+        REQUIRE(errors.size() == 2);
+        CHECK(errors[0].type() == scrp::parser_error_type::duplicate_attribute);
+        CHECK(errors[1].type() == scrp::parser_error_type::duplicate_attribute);
+    }
+
+    SECTION("Stopped by the caller")
+    {
+        scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+        tok.stop();
+        CHECK(tok.try_tokenize() == scrp::tokenize_status::stopped);
+    }
+
+    SECTION("Budgets larger than a reservation of the pool")
+    {
+        scrp::Tokenizer whole { scrp::sc_string { document.data(), document.size() } };
+        whole.keep_tokens();
+        whole.set_parser(&test_parser);
+        REQUIRE(whole.tokenize() == true);
+
+        for (const std::size_t budget : { std::size_t { 5000 }, std::size_t { 1 } << 20, std::numeric_limits<std::size_t>::max() })
+        {
+            scrp::Tokenizer tok { scrp::sc_string { document.data(), document.size() } };
+            tok.keep_tokens();
+            tok.set_parser(&test_parser);
+            CHECK(tok.try_tokenize(budget) == scrp::tokenize_status::done);
+            CHECK(describe_tokens(tok) == describe_tokens(whole));
+            // What is reserved ahead is bounded whatever the budget
+            CHECK(tok.tokens().capacity() <= 65536);
+
+            scrp::Tokenizer dropped { scrp::sc_string { document.data(), document.size() } };
+            dropped.set_parser(&test_parser);
+            CHECK(dropped.try_tokenize(budget) == scrp::tokenize_status::done);
+        }
+    }
+
+#if defined(__linux__)
+    SECTION("An allocation that fails")
+    {
+        std::string large;
+        for (int i = 0; i < 400000; ++i)
+            large += "<a>";
+
+        scrp::Tokenizer tok { scrp::sc_string { large.data(), large.size() } };
+        tok.keep_tokens();
+        tok.set_parser(&test_parser);
+
+        // The process is left 16 MiB of address space, less than the buffer of the tokens grows to
+        std::size_t pages = 0;
+        std::ifstream("/proc/self/statm") >> pages;
+
+        rlimit previous {};
+        REQUIRE(getrlimit(RLIMIT_AS, &previous) == 0);
+        rlimit limited   = previous;
+        limited.rlim_cur = pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) + (std::size_t { 16 } << 20);
+        REQUIRE(setrlimit(RLIMIT_AS, &limited) == 0);
+
+        const auto status = tok.try_tokenize();
+        setrlimit(RLIMIT_AS, &previous);
+
+        CHECK(status == scrp::tokenize_status::out_of_memory);
+        CHECK(tok.stopped());
+        CHECK(tok.tokens().size() < 400000);
+    }
+#endif /*__linux__*/
+}
+
+TEST_CASE("Error policies")
+{
+    scrp::initialize();
+    scrp::parser test_parser;
+
+    static_assert(sizeof(scrp::error_record) == 8);
+
+    // Offsets past 4 GiB are kept whole
+    constexpr scrp::error_record far { (std::size_t { 1 } << 40) + 3, scrp::parser_error_type::unknown_named_character_reference };
+    static_assert(far.offset() == (std::size_t { 1 } << 40) + 3);
+    static_assert(far.type() == scrp::parser_error_type::unknown_named_character_reference);
+    static_assert(scrp::error_record { scrp::error_record::max_offset, scrp::parser_error_type::duplicate_attribute }.offset() == scrp::error_record::max_offset);
+
+    const std::string_view document = "<p a=1 a=2\na=3 a=4></p x=1>";
+
+    const auto tokenize = [&](scrp::Tokenizer &tok) {
+        tok.reset(scrp::sc_string { document.data(), document.size() });
+        REQUIRE(tok.tokenize() == true);
+    };
+
+    scrp::Tokenizer tok;
+    tok.set_parser(&test_parser);
+
+    SECTION("Every error is kept")
+    {
+        tokenize(tok);
+        CHECK(tok.error_count() == 4);
+
+        const auto records = tok.parse_errors();
+        const auto errors  = tok.get_parse_errors();
+        REQUIRE(records.size() == 4);
+        REQUIRE(errors.size() == 4);
+        for (std::size_t i = 0; i < records.size(); ++i)
+        {
+            const auto error = tok.describe_error(records[i]);
+            CHECK(records[i].type() == errors[i].type());
+            CHECK(records[i].offset() == errors[i].pos());
+            CHECK(error.line() == errors[i].line());
+            CHECK(error.line_offset() == errors[i].line_offset());
+        }
+
+        CHECK(errors[2].line() == 2);
+        CHECK(errors[3].type() == scrp::parser_error_type::end_tag_with_attributes);
+    }
+
+    SECTION("The first errors are kept")
+    {
+        tok.set_error_policy(scrp::error_policy::first, 2);
+        tokenize(tok);
+        CHECK(tok.error_count() == 4);
+        REQUIRE(tok.parse_errors().size() == 2);
+        CHECK(tok.parse_errors()[1].type() == scrp::parser_error_type::duplicate_attribute);
+
+        // The policy is kept by reset()
+        tokenize(tok);
+        CHECK(tok.parse_errors().size() == 2);
+    }
+
+    SECTION("Errors are only counted")
+    {
+        tok.set_error_policy(scrp::error_policy::count);
+        tokenize(tok);
+        CHECK(tok.error_count() == 4);
+        CHECK(tok.parse_errors().empty());
+        CHECK(tok.get_parse_errors().empty());
+    }
+
+    SECTION("Errors are ignored")
+    {
+        tok.set_error_policy(scrp::error_policy::off);
+        tokenize(tok);
+        CHECK(tok.error_count() == 0);
+        CHECK(tok.parse_errors().empty());
+    }
+}
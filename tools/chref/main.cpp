@@ -12,6 +12,7 @@
 #include <climits>
 #include <cstdint>
 #include <fmt/core.h>
+#include <map>
 #include <utility>
 
 #include "../../scrapper/include/crc64.hpp"
@@ -4390,7 +4391,69 @@ namespace scrp::encoding
 
 } // namespace scrp::encoding
 
-int main()
+// Prints a trie of the references in data. Node 0 is the root; the edges of a node are contiguous and sorted by label
+// so the tokenizer can advance one node per input character and keep the longest reference found
+static void print_trie(const std::vector<scrp::encoding::character_reference> &data)
+{
+    struct node
+    {
+        std::map<char, std::size_t> children;
+        int reference { -1 };
+    };
+
+    std::vector<node> trie(1);
+    std::size_t max_size = 0;
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        std::size_t current = 0;
+        for (const auto &ch : data[i].data)
+        {
+            auto it = trie[current].children.find(ch);
+            if (it == trie[current].children.end())
+            {
+                trie.emplace_back();
+                it = trie[current].children.emplace(ch, trie.size() - 1).first;
+            }
+            current = it->second;
+        }
+        trie[current].reference = static_cast<int>(i);
+        max_size                = std::max(max_size, data[i].data.size());
+    }
+
+    // Number the nodes in breadth first order so the children of every node are contiguous
+    std::vector<std::size_t> order { 0 };
+    std::vector<std::size_t> index(trie.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        index[order[i]] = i;
+        for (const auto &[ch, child] : trie[order[i]].children)
+            order.push_back(child);
+    }
+
+    fmt::print("inline constexpr std::array<chref_trie_node, {}> chref_trie_nodes {{\n{{", order.size());
+    std::size_t first_edge = 0;
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        const auto &n = trie[order[i]];
+        fmt::print("{}{{ {}, {}, {} }},", i % 8 == 0 ? "\n    " : " ", n.children.empty() ? 0 : first_edge, n.children.size(), n.reference);
+        first_edge += n.children.size();
+    }
+    fmt::print("\n}}}};\n\n");
+
+    fmt::print("inline constexpr std::array<chref_trie_edge, {}> chref_trie_edges {{\n{{", order.size() - 1);
+    std::size_t edge = 0;
+    for (const auto &i : order)
+    {
+        for (const auto &[ch, child] : trie[i].children)
+        {
+            fmt::print("{}{{ '{}', {} }},", edge % 8 == 0 ? "\n    " : " ", ch, index[child]);
+            ++edge;
+        }
+    }
+    fmt::print("\n}}}};\n\nconstexpr std::size_t max_reference_size = {};\n", max_size);
+}
+
+int main(int argc, char **argv)
 {
     std::vector<scrp::encoding::character_reference> data;
 
@@ -4401,8 +4464,14 @@ int main()
 
     std::sort(data.begin(), data.end(), [](const scrp::encoding::character_reference &p0, const scrp::encoding::character_reference &p1) { return p0.crc64 < p1.crc64; });
 
+    if (argc > 1 && std::string_view { argv[1] } == "trie")
+    {
+        print_trie(data);
+        return 0;
+    }
+
     auto min = data[0].data.size();
-    fmt::print("constexpr std::array<character_reference, {}> chref_table {{\n{{", data.size());
+    fmt::print("inline constexpr std::array<character_reference, {}> chref_table {{\n{{", data.size());
     for (const auto &tb : data)
     {
         min = std::min(min, tb.data.size());